@@ -18,6 +18,11 @@ _______________________________________________________________________________*
 #include <openssl/sha.h>    // for SHA256()
 #include <openssl/evp.h>
 #include <openssl/hmac.h>
+#include "crp_crypto.h"     // cached algorithm handles and contexts
+
+// Call once at start-up, before any of the functions below, e.g.
+//     crp_crypto_init(CRP_ALG_SHA256 | CRP_ALG_BLAKE2S | CRP_ALG_CHACHA20, CRP_INIT_SHORT_LIVED);
+// (list only the algorithms the program uses; CRP_ALG_SHA256 covers HMAC_SHA256)
 
 //Function prototypes
 unsigned char* Read_File (char fileName[], int *fileLen);
@@ -90,39 +95,15 @@ unsigned char* PRNG(unsigned char *seed, size_t seed_len, size_t output_len)
 
     // Output buffer
     unsigned char* output = malloc(output_len + 1); // +1 for possible null terminator
-    unsigned char plaintext[output_len];
-    memset(plaintext, 0, sizeof(plaintext));  // Encrypting zeros
-
-    // Initialize ChaCha20 context
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-        fprintf(stderr, "Failed to create cipher context.\n");
-        return NULL;
-    }
 
-    if (EVP_EncryptInit_ex(ctx, EVP_chacha20(), NULL, NULL, NULL) != 1) {
-        fprintf(stderr, "Failed to initialize cipher.\n");
-        EVP_CIPHER_CTX_free(ctx);
+    // ChaCha20 over zeros is just the keystream; the cipher is fetched once and
+    // its context reused across calls (see crp_crypto.h)
+    if (output == NULL || !crp_chacha20_keystream(seed, iv, output, output_len)) {
+        fprintf(stderr, "ChaCha20 keystream generation failed.\n");
+        free(output);
         return NULL;
     }
 
-    // Set seed and nonce
-    if (EVP_EncryptInit_ex(ctx, NULL, NULL, seed, iv) != 1) {
-        fprintf(stderr, "Failed to set key and nonce.\n");
-        EVP_CIPHER_CTX_free(ctx);
-        return NULL;
-    }
-
-    // Encrypt (in the context of chacha20, simply XORs plaintext with keystream, and since plaintext is zeroes, result is just keystream)
-    int outlen = 0;
-    if (EVP_EncryptUpdate(ctx, output, &outlen, plaintext, sizeof(plaintext)) != 1) {
-        fprintf(stderr, "Encryption failed.\n");
-        EVP_CIPHER_CTX_free(ctx);
-        return NULL;
-    }
-
-    EVP_CIPHER_CTX_free(ctx);
-
     return output;
 }
 
@@ -198,33 +179,38 @@ unsigned char *SHA256(const unsigned char *data, size_t count, unsigned char *md
 
 unsigned char* Hash_Blake2s(unsigned char* input, unsigned long inputlen) {
     unsigned char *hash_result = (unsigned char*) malloc(EVP_MAX_MD_SIZE); // malloc the EVP max size, which is 64, setting to 32 or 33 gives intermittent memory errors
-    int hash_len; // ends up set to 32 during EVP_DigestFinal, unused
-    
-    const EVP_MD* md = EVP_get_digestbyname("BLAKE2s256"); // Get the BLAKE2s hashing (digest) algorithm
-    EVP_MD_CTX* mdctx = EVP_MD_CTX_new(); // Create the digest context required for next parts
-    EVP_DigestInit_ex(mdctx, md, NULL); // Initialize the digest context for hashing with Blake2s
-    EVP_DigestUpdate(mdctx, input, inputlen); // Update the digest context with the input to be hashed
-    EVP_DigestFinal_ex(mdctx, hash_result, &hash_len); // Finalize the hash computation, putting result in hash_result
 
-    EVP_MD_CTX_free(mdctx);
+    // BLAKE2s256 is fetched once and the digest context reused (see crp_crypto.h),
+    // instead of a name lookup and a new context on every call
+    if (hash_result == NULL || !crp_blake2s(input, inputlen, hash_result)) {
+        fprintf(stderr, "BLAKE2s hashing failed.\n");
+        free(hash_result);
+        return NULL;
+    }
 
     return hash_result;
 }
 
 /*============================
-        HMAC Function using OpenSSL's HMAC() and EVP_sha256() as the hashing function
+        HMAC Function with SHA-256 as the hashing function
 ==============================*/
 /*
-    Parameters and value types for OpenSSL's HMAC function:
-    unsigned char *HMAC(const EVP_MD *evp_md, const void *key, int key_len,
+    Same parameters and result as OpenSSL's
+    unsigned char *HMAC(EVP_sha256(), const void *key, int key_len,
                     const unsigned char *data, size_t data_len,
                     unsigned char *md, unsigned int *md_len);
-    Note md_len in the arguments is passed as a pointer, the length of the hash output is put into that variable
+    but runs on one HMAC context per thread, with SHA-256 selected once and the key set
+    on each call (see crp_crypto.h; a -DCRP_SHA256_LOWLEVEL build uses no context).
+    Note result_n is passed as a pointer, the length of the hash output is put into that variable
 */
 unsigned char* HMAC_SHA256(const unsigned char *key, int key_n,
                               const unsigned char *data, size_t data_n,
                               unsigned char *result, unsigned int *result_n) {
-    return HMAC(EVP_sha256(), key, key_n, data, data_n, result, result_n);
+    if (!crp_hmac_sha256(key, key_n, data, data_n, result)) {
+        return NULL;
+    }
+    *result_n = 32;
+    return result;
 }
 
 //__________________________________________________________________________________________________________________________
@@ -17,15 +17,17 @@
  #define HASH_SIZE 32
  #define MESSAGE_SIZE 32  // Message is guaranteed to be 32 bytes
  
+ #include "crp_engine.h"
+ #include "crp_session.h"
+ #include "crp_trace.h"
+ 
  // Function prototypes
  unsigned char* Read_File(char fileName[], int *fileLen);
  void Write_File(char fileName[], char input[]);
  void Convert_to_Hex(char output[], unsigned char input[], int inputlength);
- void Convert_To_Uchar(char* input_hex, unsigned char output[], int output_len);
  void Show_in_Hex(char name[], unsigned char input[], int inputlen);
  int read_counter_or_nonce(char* filename);
  void write_counter_or_nonce(char* filename, int value);
- void xor_arrays(unsigned char* a, unsigned char* b, unsigned char* result, int len);
  
  /*============================
          Read from File
@@ -70,24 +72,7 @@
  ==============================*/
  void Convert_to_Hex(char output[], unsigned char input[], int inputlength)
  {
-     for (int i = 0; i < inputlength; i++) {
-         sprintf(&output[2*i], "%02x", input[i]);
-     }
-     output[2*inputlength] = '\0';  // Null terminate
- }
- 
- /*===================================
-         Convert from Hex to unsigned char 
- =====================================*/
- void Convert_To_Uchar(char* input_hex, unsigned char output[], int output_len)
- {   
-     for(int i = 0; i < output_len; i++){
-         char tmp[3];
-         tmp[0] = input_hex[2*i];
-         tmp[1] = input_hex[2*i+1];
-         tmp[2] = '\0';
-         output[i] = (unsigned char)strtol(tmp, NULL, 16);
-     }
+     crp_to_hex(output, input, inputlength);  // Null terminates
  }
  
  /*============================
@@ -138,16 +123,6 @@
      fclose(file);
  }
  
- /*============================
-         XOR two arrays
- ==============================*/
- void xor_arrays(unsigned char* a, unsigned char* b, unsigned char* result, int len)
- {
-     for (int i = 0; i < len; i++) {
-         result[i] = a[i] ^ b[i];
-     }
- }
- 
  int main(int argc, char *argv[])
  {
      if (argc != 5) {
@@ -181,49 +156,89 @@
      Convert_to_Hex(hex_output, shared_key, key_len);
      Write_File("Key.txt", hex_output);
      
-     // Step 3: Encrypt message with XOR: c = m ⊕ H(k||ctr)
-     // First, create k||ctr concatenation
-     char counter_str[20];
-     sprintf(counter_str, "%d", counter);
-     unsigned char* key_counter = malloc(key_len + strlen(counter_str));
-     memcpy(key_counter, shared_key, key_len);
-     memcpy(key_counter + key_len, counter_str, strlen(counter_str));
+     // Session mode: keep using Session.txt if present, or propose it when CRP_SESSION is set
+     int session_counter, session_nonce;
+     int use_session = crp_session_load(CRP_SESSION_FILE, &session_counter, &session_nonce);
+     if (use_session < 0) {
+         printf("Error reading session parameters: %s\n", CRP_SESSION_FILE);
+         exit(1);
+     }
+     if (use_session == 0 && crp_session_requested()) {
+         if (!crp_session_store(CRP_SESSION_FILE, counter, nonce)) {
+             printf("Error opening file for writing: %s\n", CRP_SESSION_FILE);
+             exit(1);
+         }
+         session_counter = counter;
+         session_nonce = nonce;
+         use_session = 1;
+     }
      
-     // Hash k||ctr
-     unsigned char hash_key_counter[HASH_SIZE];
-     SHA256(key_counter, key_len + strlen(counter_str), hash_key_counter);
+     crp_trace_record trace = {0};
+     trace.role = CRP_TRACE_ALICE;
+     trace.mode = use_session ? CRP_TRACE_SESSION : CRP_TRACE_LEGACY;
+     trace.counter = counter;
+     trace.nonce = nonce;
+     trace.session_counter = use_session ? session_counter : 0;
+     trace.session_nonce = use_session ? session_nonce : 0;
+     trace.key = shared_key;
+     trace.key_len = key_len;
+     memcpy(trace.message, message, MESSAGE_SIZE);
      
-     // XOR message with hash to get ciphertext
-     unsigned char ciphertext[MESSAGE_SIZE];
-     xor_arrays(message, hash_key_counter, ciphertext, MESSAGE_SIZE);
+     // One-time crypto setup, after the first output so that loading OpenSSL's
+     // provider does not delay it; session mode fetches HKDF on first use
+     if (!crp_crypto_init(CRP_ALG_SHA256, CRP_INIT_SHORT_LIVED)) {
+         printf("OpenSSL does not provide SHA-256\n");
+         return 1;
+     }
      
-     // Step 4: Write ciphertext in hex format to Ciphertext.txt
-     Convert_to_Hex(hex_output, ciphertext, MESSAGE_SIZE);
-     Write_File("Ciphertext.txt", hex_output);
+     crp_session session;
+     if (use_session) {
+         if (!crp_session_init(&session, shared_key, key_len, session_counter, session_nonce)) {
+             printf("Error deriving session keys\n");
+             exit(1);
+         }
+         printf("Alice: Session mode (started at counter %d, nonce %d)\n", session_counter, session_nonce);
+     }
      
-     // Step 5: Compute signature using HMAC: sig = HMAC_k(c||nonce)
-     char nonce_str[20];
-     sprintf(nonce_str, "%d", nonce);
-     unsigned char* cipher_nonce = malloc(MESSAGE_SIZE + strlen(nonce_str));
-     memcpy(cipher_nonce, ciphertext, MESSAGE_SIZE);
-     memcpy(cipher_nonce + MESSAGE_SIZE, nonce_str, strlen(nonce_str));
+     // Engine time only: key derivation is a one-off per session, not per message
+     uint64_t started = crp_now_ns();
      
+     // Step 3: Encrypt message with XOR: c = m ⊕ H(k||ctr)
+     // Step 5: Compute signature using HMAC: sig = HMAC_k(c||nonce)
+     // (session mode uses the derived subkeys in place of k)
+     unsigned char ciphertext[MESSAGE_SIZE];
      unsigned char signature[HASH_SIZE];
-     unsigned int sig_len;
-     HMAC(EVP_sha256(), shared_key, key_len, cipher_nonce, MESSAGE_SIZE + strlen(nonce_str), signature, &sig_len);
+     if (use_session) {
+         int ok = crp_session_alice_challenge(&session, counter, nonce, message, ciphertext, signature);
+         crp_session_free(&session);
+         if (!ok) {
+             printf("Error computing session signature\n");
+             exit(1);
+         }
+     } else if (!crp_alice_challenge(shared_key, key_len, counter, nonce, message, ciphertext, signature)) {
+         printf("Error computing signature\n");
+         exit(1);
+     }
+     trace.elapsed_ns = crp_now_ns() - started;
+     memcpy(trace.ciphertext, ciphertext, MESSAGE_SIZE);
+     memcpy(trace.signature, signature, HASH_SIZE);
+     
+     // Step 4: Write ciphertext in hex format to Ciphertext.txt
+     CRP_KERNEL(to_hex, MESSAGE_SIZE)(hex_output, ciphertext);
+     Write_File("Ciphertext.txt", hex_output);
      
      // Step 6: Write signature in hex format to Signature.txt
-     Convert_to_Hex(hex_output, signature, sig_len);
+     CRP_KERNEL(to_hex, HASH_SIZE)(hex_output, signature);
      Write_File("Signature.txt", hex_output);
      
      // Step 7: Read Bob's response from Response.txt (graceful exit if doesn't exist)
      FILE* response_file = fopen("Response.txt", "r");
      if (response_file == NULL) {
          printf("Alice: Response.txt not found. Bob hasn't responded yet. Exiting gracefully.\n");
+         trace.status = CRP_TRACE_NO_RESPONSE;
+         crp_trace_append(&trace);
          free(message);
          free(shared_key);
-         free(key_counter);
-         free(cipher_nonce);
          return 0;
      }
      fclose(response_file);
@@ -237,30 +252,29 @@
      
      // Convert Bob's response from hex to binary
      unsigned char bob_response[HASH_SIZE];
-     Convert_To_Uchar((char*)bob_response_hex, bob_response, HASH_SIZE);
+     CRP_KERNEL(from_hex, HASH_SIZE)(bob_response, (char*)bob_response_hex);
      
      // Step 8: Compute expected response: response' = H(m||(ctr+1)||(nonce+1))
-     char expected_counter_str[20];
-     char expected_nonce_str[20];
-     sprintf(expected_counter_str, "%d", counter + 1);
-     sprintf(expected_nonce_str, "%d", nonce + 1);
-     
-     unsigned char* msg_ctr_nonce = malloc(MESSAGE_SIZE + strlen(expected_counter_str) + strlen(expected_nonce_str));
-     memcpy(msg_ctr_nonce, message, MESSAGE_SIZE);
-     memcpy(msg_ctr_nonce + MESSAGE_SIZE, expected_counter_str, strlen(expected_counter_str));
-     memcpy(msg_ctr_nonce + MESSAGE_SIZE + strlen(expected_counter_str), expected_nonce_str, strlen(expected_nonce_str));
-     
-     unsigned char expected_response[HASH_SIZE];
-     SHA256(msg_ctr_nonce, MESSAGE_SIZE + strlen(expected_counter_str) + strlen(expected_nonce_str), expected_response);
-     
      // Step 9: Compare responses and write result
-     if (memcmp(bob_response, expected_response, HASH_SIZE) == 0) {
+     started = crp_now_ns();
+     int acknowledged = crp_alice_verify(message, counter, nonce, bob_response);
+     trace.elapsed_ns += crp_now_ns() - started;
+     if (acknowledged == CRP_ENGINE_ERROR) {
+         printf("Error computing expected response\n");
+         exit(1);
+     }
+     memcpy(trace.response, bob_response, HASH_SIZE);
+     
+     if (acknowledged) {
          Write_File("Acknowledgment.txt", "Acknowledgment Successful");
          printf("Alice: Acknowledgment Successful!\n");
+         trace.status = CRP_TRACE_OK;
      } else {
          Write_File("Acknowledgment.txt", "Acknowledgment Failed");
          printf("Alice: Acknowledgment Failed!\n");
+         trace.status = CRP_TRACE_ACK_FAILED;
      }
+     crp_trace_append(&trace);
      
      // Step 10: Update counter and nonce
      write_counter_or_nonce(argv[3], counter + 1);
@@ -269,10 +283,7 @@
      // Cleanup
      free(message);
      free(shared_key);
-     free(key_counter);
-     free(cipher_nonce);
      free(bob_response_hex);
-     free(msg_ctr_nonce);
      
      printf("Alice: Protocol completed successfully!\n");
      return 0;
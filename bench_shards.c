@@ -0,0 +1,559 @@
+/**************************
+ *      Shard Benchmark        *
+ **************************
+ *
+ * Measures how bob_server throughput scales with the number of shards and
+ * how the load spreads across them.
+ *
+ * For 1, 2, 4, ... up to max_workers shards it starts ./bob_server on a
+ * generated keyring, connects one client thread per peer (following the
+ * WRONG_SHARD redirect to the peer's owner when SO_REUSEPORT lands it on
+ * another shard), sends every peer's precomputed challenges back to back and
+ * checks each response. Alice-side work is done before the timer starts, so
+ * the numbers are Bob's.
+ *
+ * Two spreads are reported per run. The first hop is the shard SO_REUSEPORT
+ * picked for the connection to the shared port, i.e. how evenly the kernel
+ * balances. Ownership (peer_id % shards) is where the peer ends up after the
+ * redirect, and so where its handshakes are served.
+ *
+ * After each run it also checks that the server keeps peer state across
+ * connections: a replayed challenge and a second HELLO must be rejected, a
+ * new connection must take over a peer whose holder has not verified a MSG
+ * yet, and once it has, another connection must get PEER_BUSY. The exit
+ * status is 1 if any check fails.
+ *
+ * Usage: ./bench_shards [peers] [messages_per_peer] [max_workers] [legacy|session]
+ *        (defaults: 64 peers, 2000 messages, one worker per available CPU, legacy)
+ * Build: gcc -O2 bench_shards.c -lssl -lcrypto -lpthread -lm -o bench_shards   (Linux only)
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define HASH_SIZE 32
+#define MESSAGE_SIZE 32
+
+#include "crp_engine.h"
+#include "crp_session.h"
+#include "crp_trace.h"   // crp_now_ns()
+#include "crp_wire.h"
+
+#define KEYRING_FILE "bench_keyring.txt"
+#define SERVER_PATH "./bob_server"
+#define BASE_PORT 5600
+#define MAX_SHARDS 255
+
+typedef struct {
+    unsigned char key[80];
+    size_t key_len;
+    int counter;
+    int nonce;
+    unsigned char *frames;      // messages * CRP_WIRE_MSG_LEN, ready to send
+    unsigned char *expected;    // messages * HASH_SIZE responses
+} peer;
+
+typedef struct {
+    int id;
+    int port;
+    int mode;
+    long messages;
+    peer *p;
+    pthread_barrier_t *ready;
+    int first_hop;              // Filled in by the thread: shard SO_REUSEPORT picked,
+    int shard;                  // and the owner that served the peer (-1 if none)
+    long ok;
+    long mismatches;
+} client_arg;
+
+/*============================
+        Blocking full read/write
+==============================*/
+static int read_full(int fd, unsigned char *buf, size_t len)
+{
+    size_t have = 0;
+    while (have < len) {
+        ssize_t got = read(fd, buf + have, len - have);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) continue;
+            return 0;
+        }
+        have += got;
+    }
+    return 1;
+}
+
+static int write_full(int fd, const unsigned char *buf, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t put = write(fd, buf + sent, len - sent);
+        if (put <= 0) {
+            if (put < 0 && errno == EINTR) continue;
+            return 0;
+        }
+        sent += put;
+    }
+    return 1;
+}
+
+static int connect_loopback(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+/*============================
+        HELLO
+==============================*/
+// Returns the reply status and fills the shard that answered and, for
+// WRONG_SHARD, the owner; -1 if the connection failed
+static int send_hello(int fd, int mode, int id, int *shard, int *owner)
+{
+    unsigned char hello[CRP_WIRE_HELLO_LEN] = {CRP_WIRE_HELLO, (unsigned char)mode, 0, 0};
+    unsigned char reply[CRP_WIRE_HELLO_REPLY_LEN];
+    crp_wire_put_u32(hello + 4, (uint32_t)id);
+    if (!write_full(fd, hello, sizeof(hello)) || !read_full(fd, reply, sizeof(reply))) {
+        return -1;
+    }
+    *shard = reply[2];
+    *owner = reply[3];
+    return reply[1];
+}
+
+// Connects peer 'id' to the shard that owns it, following one WRONG_SHARD
+// redirect. Returns the HELLO status and the connected fd in *fd (-1 if none);
+// *first_hop is the shard that answered on the shared port, *shard the last.
+static int connect_peer(int port, int mode, int id, int *fd, int *first_hop, int *shard)
+{
+    int owner = -1;
+    *first_hop = *shard = -1;
+    *fd = connect_loopback(port);
+    int status = *fd >= 0 ? send_hello(*fd, mode, id, first_hop, &owner) : -1;
+    *shard = *first_hop;
+    if (status == CRP_WIRE_WRONG_SHARD) {
+        close(*fd);
+        *fd = connect_loopback(port + 1 + owner);
+        status = *fd >= 0 ? send_hello(*fd, mode, id, shard, &owner) : -1;
+    }
+    return status;
+}
+
+/*============================
+        Generate peers and challenges
+==============================*/
+static peer* make_peers(int peers, long messages, int mode)
+{
+    peer *all = calloc(peers, sizeof(peer));
+    FILE *file = fopen(KEYRING_FILE, "w");
+    if (file == NULL) {
+        printf("Error opening file for writing: %s\n", KEYRING_FILE);
+        exit(1);
+    }
+
+    for (int i = 0; i < peers; i++) {
+        peer *p = &all[i];
+        p->key_len = 16 + rand() % 64;   // Mix of short and long shared keys
+        for (size_t b = 0; b < p->key_len; b++) {
+            p->key[b] = (unsigned char)rand();
+        }
+        p->counter = 1 + rand() % 1000;
+        p->nonce = 1 + rand() % 100000;
+
+        char hex[2 * sizeof(p->key) + 1];
+        crp_to_hex(hex, p->key, p->key_len);
+        fprintf(file, "%s %d %d\n", hex, p->counter, p->nonce);
+
+        crp_session session;
+        if (mode == CRP_WIRE_SESSION &&
+            !crp_session_init(&session, p->key, p->key_len, p->counter, p->nonce)) {
+            printf("Error deriving session keys\n");
+            exit(1);
+        }
+
+        p->frames = calloc(messages, CRP_WIRE_MSG_LEN);
+        p->expected = malloc(messages * HASH_SIZE);
+        for (long m = 0; m < messages; m++) {
+            unsigned char message[MESSAGE_SIZE];
+            for (int b = 0; b < MESSAGE_SIZE; b++) {
+                message[b] = (unsigned char)rand();
+            }
+            int ctr = p->counter + (int)m;
+            int nonce = p->nonce + (int)m;
+            unsigned char *frame = p->frames + m * CRP_WIRE_MSG_LEN;
+            frame[0] = CRP_WIRE_MSG;
+            if (mode == CRP_WIRE_SESSION) {
+                if (!crp_session_alice_challenge(&session, ctr, nonce, message, frame + 4, frame + 4 + MESSAGE_SIZE)) {
+                    printf("Error computing session signature for peer %d\n", i);
+                    exit(1);
+                }
+            } else if (!crp_alice_challenge(p->key, p->key_len, ctr, nonce, message, frame + 4, frame + 4 + MESSAGE_SIZE)) {
+                printf("Error computing signature for peer %d\n", i);
+                exit(1);
+            }
+            if (!crp_response(message, ctr, nonce, p->expected + m * HASH_SIZE)) {
+                printf("Error computing response for peer %d\n", i);
+                exit(1);
+            }
+        }
+        if (mode == CRP_WIRE_SESSION) {
+            crp_session_free(&session);
+        }
+    }
+
+    fclose(file);
+    return all;
+}
+
+/*============================
+        Client thread (one peer)
+==============================*/
+static void* client_main(void *varg)
+{
+    client_arg *arg = varg;
+    arg->shard = -1;
+
+    int fd, shard;
+    int ok = connect_peer(arg->port, arg->mode, arg->id, &fd, &arg->first_hop, &shard) == CRP_WIRE_OK;
+    if (ok) {
+        arg->shard = shard;
+    }
+    unsigned char reply[CRP_WIRE_MSG_REPLY_LEN];
+
+    // Every peer is connected before anyone starts sending
+    pthread_barrier_wait(arg->ready);
+
+    for (long m = 0; ok && m < arg->messages; m++) {
+        if (!write_full(fd, arg->p->frames + m * CRP_WIRE_MSG_LEN, CRP_WIRE_MSG_LEN) ||
+            !read_full(fd, reply, CRP_WIRE_MSG_REPLY_LEN)) {
+            break;
+        }
+        if (reply[1] == CRP_WIRE_OK && memcmp(reply + 4, arg->p->expected + m * HASH_SIZE, HASH_SIZE) == 0) {
+            arg->ok++;
+        } else {
+            arg->mismatches++;
+        }
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    return NULL;
+}
+
+/*============================
+        Peer state checks
+==============================*/
+// Sends one MSG and returns the reply status, -1 if the connection failed
+static int send_msg(int fd, const unsigned char frame[CRP_WIRE_MSG_LEN], unsigned char reply[CRP_WIRE_MSG_REPLY_LEN])
+{
+    if (!write_full(fd, frame, CRP_WIRE_MSG_LEN) || !read_full(fd, reply, CRP_WIRE_MSG_REPLY_LEN)) {
+        return -1;
+    }
+    return reply[1];
+}
+
+// Peer 0 already had its first 'messages' challenges accepted. Returns 1 if
+// the server rejects a replay on a new connection and a second HELLO, lets a
+// new connection take over while the first has not verified, accepts the next
+// challenge there, and then refuses a third connection.
+static int check_peer_state(int port, int mode, peer *p, long messages)
+{
+    int fd, second_fd, third_fd, first_hop, shard, owner;
+    unsigned char reply[CRP_WIRE_MSG_REPLY_LEN];
+    int ok = 1;
+
+    if (connect_peer(port, mode, 0, &fd, &first_hop, &shard) != CRP_WIRE_OK) {
+        printf("            state check: peer 0 could not reconnect\n");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+
+    int status = send_msg(fd, p->frames, reply);
+    if (status != CRP_WIRE_SIG_FAILED) {
+        printf("            state check: replayed challenge got status %d, expected %d\n",
+               status, CRP_WIRE_SIG_FAILED);
+        ok = 0;
+    }
+
+    status = send_hello(fd, mode, 0, &shard, &owner);
+    if (status != CRP_WIRE_DUPLICATE_HELLO) {
+        printf("            state check: second HELLO got status %d, expected %d\n",
+               status, CRP_WIRE_DUPLICATE_HELLO);
+        ok = 0;
+    }
+
+    // Nothing has verified on the first connection, so a new HELLO takes over
+    status = connect_peer(port, mode, 0, &second_fd, &first_hop, &shard);
+    if (status != CRP_WIRE_OK) {
+        printf("            state check: second connection got status %d, expected %d\n",
+               status, CRP_WIRE_OK);
+        ok = 0;
+    }
+    status = send_msg(fd, p->frames, reply);
+    if (status != CRP_WIRE_NO_HELLO) {
+        printf("            state check: replaced connection got status %d, expected %d\n",
+               status, CRP_WIRE_NO_HELLO);
+        ok = 0;
+    }
+
+    // The next challenge in sequence verifies and makes the peer busy
+    unsigned char frame[CRP_WIRE_MSG_LEN] = {CRP_WIRE_MSG};
+    unsigned char message[MESSAGE_SIZE] = {0};
+    unsigned char expected[HASH_SIZE];
+    int ctr = p->counter + (int)messages;
+    int nonce = p->nonce + (int)messages;
+    crp_session session;
+    if (mode == CRP_WIRE_SESSION) {
+        // The server derived this connection's subkeys from the state at HELLO
+        if (!crp_session_init(&session, p->key, p->key_len, ctr, nonce)) {
+            printf("Error deriving session keys\n");
+            exit(1);
+        }
+        if (!crp_session_alice_challenge(&session, ctr, nonce, message, frame + 4, frame + 4 + MESSAGE_SIZE)) {
+            printf("Error computing session signature for peer 0\n");
+            exit(1);
+        }
+        crp_session_free(&session);
+    } else if (!crp_alice_challenge(p->key, p->key_len, ctr, nonce, message, frame + 4, frame + 4 + MESSAGE_SIZE)) {
+        printf("Error computing signature for peer 0\n");
+        exit(1);
+    }
+    if (!crp_response(message, ctr, nonce, expected)) {
+        printf("Error computing response for peer 0\n");
+        exit(1);
+    }
+    status = second_fd >= 0 ? send_msg(second_fd, frame, reply) : -1;
+    if (status != CRP_WIRE_OK || memcmp(reply + 4, expected, HASH_SIZE) != 0) {
+        printf("            state check: next challenge got status %d, expected %d\n",
+               status, CRP_WIRE_OK);
+        ok = 0;
+    }
+
+    status = connect_peer(port, mode, 0, &third_fd, &first_hop, &shard);
+    if (status != CRP_WIRE_PEER_BUSY) {
+        printf("            state check: connection to a verified peer got status %d, expected %d\n",
+               status, CRP_WIRE_PEER_BUSY);
+        ok = 0;
+    }
+    if (third_fd >= 0) {
+        close(third_fd);
+    }
+    if (second_fd >= 0) {
+        close(second_fd);
+    }
+    close(fd);
+    return ok;
+}
+
+/*============================
+        Spread report
+==============================*/
+// One line: the count per shard, then max/mean and coefficient of variation
+static void report_spread(const char *name, const long *counts, int workers)
+{
+    long total = 0, max = 0;
+    for (int s = 0; s < workers; s++) {
+        total += counts[s];
+        if (counts[s] > max) max = counts[s];
+    }
+    double mean = (double)total / workers;
+    double variance = 0;
+    for (int s = 0; s < workers; s++) {
+        variance += (counts[s] - mean) * (counts[s] - mean);
+    }
+    printf("            %-22s", name);
+    for (int s = 0; s < workers; s++) {
+        printf(" %ld", counts[s]);
+    }
+    printf("  (max/mean %.2f, cv %.2f)\n", mean > 0 ? max / mean : 0,
+           mean > 0 ? sqrt(variance / workers) / mean : 0);
+}
+
+/*============================
+        One run with N shards
+==============================*/
+// Returns handshakes per second; clears *checks_ok if a state check fails
+static double run(int workers, int port, int peers, long messages, int mode, peer *all, int *checks_ok)
+{
+    char port_str[16], workers_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    snprintf(workers_str, sizeof(workers_str), "%d", workers);
+
+    fflush(stdout);
+    pid_t server = fork();
+    if (server == 0) {
+        execl(SERVER_PATH, SERVER_PATH, KEYRING_FILE, port_str, workers_str, (char*)NULL);
+        perror("exec " SERVER_PATH);
+        _exit(1);
+    }
+
+    // Wait until the shards accept connections
+    int probe = -1;
+    for (int tries = 0; tries < 500 && probe < 0; tries++) {
+        probe = connect_loopback(port);
+        if (probe < 0) {
+            usleep(10000);
+        }
+    }
+    if (probe < 0) {
+        printf("Bob server did not start on port %d\n", port);
+        kill(server, SIGTERM);
+        waitpid(server, NULL, 0);
+        exit(1);
+    }
+    close(probe);
+
+    pthread_t *threads = malloc(peers * sizeof(pthread_t));
+    client_arg *args = calloc(peers, sizeof(client_arg));
+    pthread_barrier_t ready;
+    pthread_barrier_init(&ready, NULL, peers + 1);
+    for (int i = 0; i < peers; i++) {
+        args[i].id = i;
+        args[i].port = port;
+        args[i].mode = mode;
+        args[i].messages = messages;
+        args[i].p = &all[i];
+        args[i].ready = &ready;
+        pthread_create(&threads[i], NULL, client_main, &args[i]);
+    }
+
+    pthread_barrier_wait(&ready);
+    uint64_t started = crp_now_ns();
+    for (int i = 0; i < peers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t elapsed = crp_now_ns() - started;
+
+    if (!check_peer_state(port, mode, &all[0], messages)) {
+        *checks_ok = 0;
+    }
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+
+    // Per-shard counts, from the shard index in the HELLO and MSG replies
+    long first_hop_peers[MAX_SHARDS] = {0};
+    long owner_peers[MAX_SHARDS] = {0};
+    long owner_handshakes[MAX_SHARDS] = {0};
+    long total = 0, mismatches = 0;
+    int unconnected = 0, redirected = 0;
+    for (int i = 0; i < peers; i++) {
+        total += args[i].ok;
+        mismatches += args[i].mismatches;
+        if (args[i].first_hop >= 0) {
+            first_hop_peers[args[i].first_hop]++;
+        }
+        if (args[i].shard < 0) {
+            unconnected++;
+            continue;
+        }
+        redirected += args[i].shard != args[i].first_hop;
+        owner_peers[args[i].shard]++;
+        owner_handshakes[args[i].shard] += args[i].ok;
+    }
+    double rate = total * 1e9 / elapsed;
+
+    printf("Shards %3d: %10.0f handshakes/s  (%ld in %.1f ms)\n", workers, rate, total, elapsed / 1e6);
+    report_spread("first hop (kernel):", first_hop_peers, workers);
+    report_spread("owner (peer % shards):", owner_peers, workers);
+    report_spread("handshakes per owner:", owner_handshakes, workers);
+    printf("            %d of %d peers redirected to their owner\n", redirected, peers);
+    if (mismatches > 0 || unconnected > 0) {
+        printf("            %ld response mismatches, %d peers could not connect\n", mismatches, unconnected);
+    }
+
+    pthread_barrier_destroy(&ready);
+    free(threads);
+    free(args);
+    return rate;
+}
+
+int main(int argc, char *argv[])
+{
+    int peers = argc > 1 ? atoi(argv[1]) : 64;
+    long messages = argc > 2 ? atol(argv[2]) : 2000;
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    int max_workers = argc > 3 ? atoi(argv[3]) : CPU_COUNT(&allowed);
+    int mode = CRP_WIRE_LEGACY;
+    if (argc > 4) {
+        if (strcmp(argv[4], "session") == 0) {
+            mode = CRP_WIRE_SESSION;
+        } else if (strcmp(argv[4], "legacy") != 0) {
+            printf("Mode must be legacy or session\n");
+            return 1;
+        }
+    }
+    if (argc > 5 || peers < 1 || messages < 1 || max_workers < 1 || max_workers > MAX_SHARDS) {
+        printf("Usage: %s [peers] [messages_per_peer] [max_workers 1-%d] [legacy|session]\n", argv[0], MAX_SHARDS);
+        return 1;
+    }
+
+    if (!crp_crypto_init(CRP_ALG_SHA256 | CRP_ALG_HMAC | CRP_ALG_HKDF, 0)) {
+        printf("OpenSSL does not provide SHA-256/HMAC/HKDF\n");
+        return 1;
+    }
+    srand(1);
+    printf("Preparing %d peers x %ld challenges (%s mode)...\n", peers, messages,
+           mode == CRP_WIRE_SESSION ? "session" : "legacy");
+    peer *all = make_peers(peers, messages, mode);
+
+    double base = 0;
+    int port = BASE_PORT;
+    int checks_ok = 1;
+    for (int workers = 1; ; workers *= 2) {
+        if (workers > max_workers) {
+            workers = max_workers;
+        }
+        // Each run uses the shared port and one directed port per shard
+        double rate = run(workers, port, peers, messages, mode, all, &checks_ok);
+        port += workers + 1;
+        if (base == 0) {
+            base = rate;
+        }
+        printf("            speedup vs 1 shard: %.2fx\n", rate / base);
+        if (workers == max_workers) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < peers; i++) {
+        free(all[i].frames);
+        free(all[i].expected);
+    }
+    free(all);
+    remove(KEYRING_FILE);
+    if (!checks_ok) {
+        printf("Peer state checks FAILED\n");
+        return 1;
+    }
+    return 0;
+}
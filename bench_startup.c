@@ -0,0 +1,155 @@
+/**************************
+ *      Cold Start Benchmark        *
+ **************************
+ *
+ * Measures how long a short-lived command (e.g. ./alice or ./bob) takes
+ * from process start to its first byte of output, and to exit, over many
+ * runs, plus the CPU time the process used (steadier than wall time on a
+ * busy machine). Run it against two builds to compare their cold-start
+ * latency.
+ *
+ * The command's standard output is a pseudo-terminal, so stdio line-buffers
+ * it as it would in a terminal and "first output" is when the first line is
+ * printed. (Through a pipe, stdio would block-buffer it and the first byte
+ * would only arrive with the flush at exit.)
+ *
+ * Usage: ./bench_startup <runs> <command> [args...]
+ * Example:
+ *     ./bench_startup 200 ./alice Message.txt SharedKey.txt A_ctr.txt A_nonce.txt
+ *
+ * The command is run as-is each time, so files it rewrites (counters,
+ * Ciphertext.txt, ...) change between runs; this does not affect timing.
+ *
+ * Build: gcc -O2 bench_startup.c -o bench_startup   (POSIX only)
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *samples, int runs)
+{
+    qsort(samples, runs, sizeof(double), compare_double);
+    double sum = 0;
+    for (int i = 0; i < runs; i++) {
+        sum += samples[i];
+    }
+    printf("%-14s min %8.1f us  median %8.1f us  mean %8.1f us  p90 %8.1f us\n",
+           name, samples[0], samples[runs / 2], sum / runs, samples[(runs * 9) / 10]);
+}
+
+/*============================
+        One timed run
+==============================*/
+// Returns 0 on success and fills the latencies and CPU time in microseconds
+static int time_run(char **command, double *first_output, double *total, double *cpu)
+{
+    // The child writes to the terminal side; the parent reads the master
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    int terminal = -1;
+    if (master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0) {
+        terminal = open(ptsname(master), O_RDWR | O_NOCTTY);
+    }
+    if (terminal < 0) {
+        perror("pseudo-terminal");
+        if (master >= 0) {
+            close(master);
+        }
+        return 1;
+    }
+
+    double started = now_us();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(master);
+        close(terminal);
+        return 1;
+    }
+    if (pid == 0) {
+        close(master);
+        dup2(terminal, STDOUT_FILENO);
+        close(terminal);
+        execvp(command[0], command);
+        perror("exec");
+        _exit(127);
+    }
+    // Once the child exits, reads on the master fail (EIO) instead of blocking
+    close(terminal);
+
+    // First byte of output, then drain the rest
+    char buf[4096];
+    ssize_t got = read(master, buf, sizeof(buf));
+    *first_output = now_us() - started;
+    while (got > 0) {
+        got = read(master, buf, sizeof(buf));
+    }
+    close(master);
+
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    *total = now_us() - started;
+    *cpu = usage.ru_utime.tv_sec * 1e6 + usage.ru_utime.tv_usec +
+           usage.ru_stime.tv_sec * 1e6 + usage.ru_stime.tv_usec;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 127;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3 || atoi(argv[1]) < 1) {
+        printf("Usage: %s <runs> <command> [args...]\n", argv[0]);
+        return 1;
+    }
+    int runs = atoi(argv[1]);
+    char **command = argv + 2;
+
+    double *first_output = malloc(runs * sizeof(double));
+    double *total = malloc(runs * sizeof(double));
+    double *cpu = malloc(runs * sizeof(double));
+
+    // One untimed run warms the page cache for the binary and its libraries
+    double ignored_first, ignored_total, ignored_cpu;
+    if (time_run(command, &ignored_first, &ignored_total, &ignored_cpu) != 0) {
+        printf("Could not run %s\n", command[0]);
+        return 1;
+    }
+    for (int i = 0; i < runs; i++) {
+        if (time_run(command, &first_output[i], &total[i], &cpu[i]) != 0) {
+            printf("Could not run %s\n", command[0]);
+            return 1;
+        }
+    }
+
+    printf("%s: %d runs\n", command[0], runs);
+    report("first output", first_output, runs);
+    report("exit", total, runs);
+    report("cpu (user+sys)", cpu, runs);
+
+    free(first_output);
+    free(total);
+    free(cpu);
+    return 0;
+}
@@ -17,15 +17,17 @@
  #define HASH_SIZE 32
  #define MESSAGE_SIZE 32  // Message is guaranteed to be 32 bytes
  
+ #include "crp_engine.h"
+ #include "crp_session.h"
+ #include "crp_trace.h"
+ 
  // Function prototypes
  unsigned char* Read_File(char fileName[], int *fileLen);
  void Write_File(char fileName[], char input[]);
  void Convert_to_Hex(char output[], unsigned char input[], int inputlength);
- void Convert_To_Uchar(char* input_hex, unsigned char output[], int output_len);
  void Show_in_Hex(char name[], unsigned char input[], int inputlen);
  int read_counter_or_nonce(char* filename);
  void write_counter_or_nonce(char* filename, int value);
- void xor_arrays(unsigned char* a, unsigned char* b, unsigned char* result, int len);
  
  /*============================
          Read from File
@@ -70,24 +72,7 @@
  ==============================*/
  void Convert_to_Hex(char output[], unsigned char input[], int inputlength)
  {
-     for (int i = 0; i < inputlength; i++) {
-         sprintf(&output[2*i], "%02x", input[i]);
-     }
-     output[2*inputlength] = '\0';  // Null terminate
- }
- 
- /*===================================
-         Convert from Hex to unsigned char 
- =====================================*/
- void Convert_To_Uchar(char* input_hex, unsigned char output[], int output_len)
- {   
-     for(int i = 0; i < output_len; i++){
-         char tmp[3];
-         tmp[0] = input_hex[2*i];
-         tmp[1] = input_hex[2*i+1];
-         tmp[2] = '\0';
-         output[i] = (unsigned char)strtol(tmp, NULL, 16);
-     }
+     crp_to_hex(output, input, inputlength);  // Null terminates
  }
  
  /*============================
@@ -138,16 +123,6 @@
      fclose(file);
  }
  
- /*============================
-         XOR two arrays
- ==============================*/
- void xor_arrays(unsigned char* a, unsigned char* b, unsigned char* result, int len)
- {
-     for (int i = 0; i < len; i++) {
-         result[i] = a[i] ^ b[i];
-     }
- }
- 
  int main(int argc, char *argv[])
  {
      if (argc != 6) {
@@ -185,67 +160,91 @@
      // Convert hex inputs to binary
      unsigned char ciphertext[MESSAGE_SIZE];
      unsigned char alice_signature[HASH_SIZE];
-     Convert_To_Uchar((char*)ciphertext_hex, ciphertext, MESSAGE_SIZE);
-     Convert_To_Uchar((char*)signature_hex, alice_signature, HASH_SIZE);
+     CRP_KERNEL(from_hex, MESSAGE_SIZE)(ciphertext, (char*)ciphertext_hex);
+     CRP_KERNEL(from_hex, HASH_SIZE)(alice_signature, (char*)signature_hex);
      
-     // Step 2: Compute expected signature: sig' = HMAC_k(c||nonce)
-     char nonce_str[20];
-     sprintf(nonce_str, "%d", nonce);
-     unsigned char* cipher_nonce = malloc(MESSAGE_SIZE + strlen(nonce_str));
-     memcpy(cipher_nonce, ciphertext, MESSAGE_SIZE);
-     memcpy(cipher_nonce + MESSAGE_SIZE, nonce_str, strlen(nonce_str));
+     // Session mode if Alice proposed it in Session.txt
+     int session_counter, session_nonce;
+     int use_session = crp_session_load(CRP_SESSION_FILE, &session_counter, &session_nonce);
+     if (use_session < 0) {
+         printf("Error reading session parameters: %s\n", CRP_SESSION_FILE);
+         exit(1);
+     }
+     
+     crp_trace_record trace = {0};
+     trace.role = CRP_TRACE_BOB;
+     trace.mode = use_session ? CRP_TRACE_SESSION : CRP_TRACE_LEGACY;
+     trace.counter = counter;
+     trace.nonce = nonce;
+     trace.session_counter = use_session ? session_counter : 0;
+     trace.session_nonce = use_session ? session_nonce : 0;
+     trace.key = shared_key;
+     trace.key_len = key_len;
+     memcpy(trace.ciphertext, ciphertext, MESSAGE_SIZE);
+     memcpy(trace.signature, alice_signature, HASH_SIZE);
+     
+     // One-time crypto setup, after the first output so that loading OpenSSL's
+     // provider does not delay it; session mode fetches HKDF on first use
+     if (!crp_crypto_init(CRP_ALG_SHA256, CRP_INIT_SHORT_LIVED)) {
+         printf("OpenSSL does not provide SHA-256\n");
+         return 1;
+     }
      
-     unsigned char expected_signature[HASH_SIZE];
-     unsigned int expected_sig_len;
-     HMAC(EVP_sha256(), shared_key, key_len, cipher_nonce, MESSAGE_SIZE + strlen(nonce_str), expected_signature, &expected_sig_len);
+     crp_session session;
+     if (use_session) {
+         if (!crp_session_init(&session, shared_key, key_len, session_counter, session_nonce)) {
+             printf("Error deriving session keys\n");
+             exit(1);
+         }
+         printf("Bob: Session mode (started at counter %d, nonce %d)\n", session_counter, session_nonce);
+     }
      
+     // Engine time only: key derivation is a one-off per session, not per message
+     uint64_t started = crp_now_ns();
+     
+     // Step 2: Compute expected signature: sig' = HMAC_k(c||nonce)
      // Step 3: Verify signature
-     if (memcmp(alice_signature, expected_signature, HASH_SIZE) != 0) {
+     // Step 4: Decrypt ciphertext: m = c ⊕ H(k||ctr)
+     // Step 5: Compute response: response = H(m||(ctr+1)||(nonce+1))
+     // (session mode uses the derived subkeys in place of k)
+     unsigned char decrypted_message[MESSAGE_SIZE];
+     unsigned char response[HASH_SIZE];
+     int verified;
+     if (use_session) {
+         verified = crp_session_bob_process(&session, counter, nonce, ciphertext, alice_signature,
+                                            decrypted_message, response);
+         crp_session_free(&session);
+     } else {
+         verified = crp_bob_process(shared_key, key_len, counter, nonce, ciphertext, alice_signature,
+                                    decrypted_message, response);
+     }
+     trace.elapsed_ns = crp_now_ns() - started;
+     
+     if (verified == CRP_SESSION_ERROR) {
+         printf(use_session ? "Error computing session signature\n" : "Error computing signature\n");
+         exit(1);
+     }
+     if (!verified) {
          printf("Bob: Signature verification failed! Exiting.\n");
+         trace.status = CRP_TRACE_SIG_FAILED;
+         crp_trace_append(&trace);
          free(ciphertext_hex);
          free(signature_hex);
          free(shared_key);
-         free(cipher_nonce);
          exit(1);
      }
      
-     printf("Bob: Signature verification successful!\n");
-     
-     // Step 4: Decrypt ciphertext: m = c ⊕ H(k||ctr)
-     // Create k||ctr concatenation
-     char counter_str[20];
-     sprintf(counter_str, "%d", counter);
-     unsigned char* key_counter = malloc(key_len + strlen(counter_str));
-     memcpy(key_counter, shared_key, key_len);
-     memcpy(key_counter + key_len, counter_str, strlen(counter_str));
-     
-     // Hash k||ctr
-     unsigned char hash_key_counter[HASH_SIZE];
-     SHA256(key_counter, key_len + strlen(counter_str), hash_key_counter);
-     
-     // XOR ciphertext with hash to get message
-     unsigned char decrypted_message[MESSAGE_SIZE];
-     xor_arrays(ciphertext, hash_key_counter, decrypted_message, MESSAGE_SIZE);
+     trace.status = CRP_TRACE_OK;
+     memcpy(trace.message, decrypted_message, MESSAGE_SIZE);
+     memcpy(trace.response, response, HASH_SIZE);
+     crp_trace_append(&trace);
      
+     printf("Bob: Signature verification successful!\n");
      printf("Bob: Message decrypted successfully!\n");
      Show_in_Hex("Bob: Decrypted message", decrypted_message, MESSAGE_SIZE);
      
-     // Step 5: Compute response: response = H(m||(ctr+1)||(nonce+1))
-     char response_counter_str[20];
-     char response_nonce_str[20];
-     sprintf(response_counter_str, "%d", counter + 1);
-     sprintf(response_nonce_str, "%d", nonce + 1);
-     
-     unsigned char* msg_ctr_nonce = malloc(MESSAGE_SIZE + strlen(response_counter_str) + strlen(response_nonce_str));
-     memcpy(msg_ctr_nonce, decrypted_message, MESSAGE_SIZE);
-     memcpy(msg_ctr_nonce + MESSAGE_SIZE, response_counter_str, strlen(response_counter_str));
-     memcpy(msg_ctr_nonce + MESSAGE_SIZE + strlen(response_counter_str), response_nonce_str, strlen(response_nonce_str));
-     
-     unsigned char response[HASH_SIZE];
-     SHA256(msg_ctr_nonce, MESSAGE_SIZE + strlen(response_counter_str) + strlen(response_nonce_str), response);
-     
      // Step 6: Write response in hex format to Response.txt
-     Convert_to_Hex(hex_output, response, HASH_SIZE);
+     CRP_KERNEL(to_hex, HASH_SIZE)(hex_output, response);
      Write_File("Response.txt", hex_output);
      
      printf("Bob: Response computed and written to Response.txt\n");
@@ -261,9 +260,6 @@
      free(ciphertext_hex);
      free(signature_hex);
      free(shared_key);
-     free(cipher_nonce);
-     free(key_counter);
-     free(msg_ctr_nonce);
      
      printf("Bob: Protocol completed successfully!\n");
      return 0;
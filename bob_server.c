@@ -0,0 +1,564 @@
+/**************************
+ *      Sharded Bob Server        *
+ **************************
+ *
+ * Runs Bob as a loopback TCP service with one worker process per core.
+ * Every worker is pinned to its own CPU and serves its own listening socket
+ * on the same port with SO_REUSEPORT, and no state is shared between them.
+ * The kernel's SO_REUSEPORT choice only decides the first hop: which worker
+ * answers a connection's HELLO. The peer's owner serves its handshakes.
+ *
+ * Peers are partitioned across shards: shard peer_id % workers owns a peer's
+ * counter/nonce state for as long as the server runs, starting from the
+ * peer's entry in the keyring, so a challenge accepted once is never accepted
+ * again, whichever connection it arrives on. A connection carries one peer
+ * (see crp_wire.h):
+ *   - a HELLO for a peer another shard owns is answered with WRONG_SHARD and
+ *     the owner's index; each shard also listens on port + 1 + shard, and the
+ *     client reconnects there
+ *   - HELLO is not authenticated, so it only holds the peer until the first
+ *     MSG on that connection verifies; until then a newer HELLO for the same
+ *     peer takes it over, and the older connection's next MSG gets NO_HELLO
+ *   - once a MSG has verified, a HELLO for that peer on another connection
+ *     is rejected with PEER_BUSY until the holder closes; a second HELLO on
+ *     the same connection is always rejected. Neither changes anything.
+ *   - a connection that sends nothing for IDLE_TIMEOUT_MS (10 s) is closed,
+ *     which releases its peer
+ * In session mode the subkeys are derived at HELLO from the peer's current
+ * counter/nonce and live as long as the connection.
+ *
+ * State is kept in memory only: restarting the server starts every peer from
+ * the keyring again, so the keyring must be updated before a restart.
+ *
+ * Keyring: one peer per line, "<key in hex> <counter> <nonce>"; the peer id
+ * is the line number starting at 0.
+ *
+ * Usage: ./bob_server <keyring_file> [port] [workers]
+ *        (defaults: port 5555, one worker per available CPU; shard i also
+ *        listens on port + 1 + i)
+ * Build: gcc -O2 bob_server.c -lssl -lcrypto -o bob_server   (Linux only)
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define HASH_SIZE 32
+#define MESSAGE_SIZE 32
+
+#include "crp_engine.h"
+#include "crp_session.h"
+#include "crp_wire.h"
+
+#define DEFAULT_PORT 5555
+#define MAX_EVENTS 256
+#define MAX_KEYRING_LINE 4096
+// Connections that send nothing for this long are closed
+#define IDLE_TIMEOUT_MS 10000
+
+typedef struct {
+    unsigned char *key;
+    size_t key_len;
+    int counter;
+    int nonce;
+} keyring_entry;
+
+typedef struct connection connection;
+
+typedef struct {
+    int counter;            // Next expected counter/nonce, kept across connections
+    int nonce;
+    connection *holder;     // Connection whose HELLO named this peer, if any
+    int verified;           // 1 once a MSG on the holder verified
+} peer_state;
+
+struct connection {
+    int fd;
+    unsigned char in[CRP_WIRE_MSG_LEN];
+    size_t have;
+    long peer;              // -1 until HELLO succeeds
+    int mode;
+    peer_state *state;      // The peer's entry in this shard's table
+    crp_session session;    // Session mode only
+    uint64_t last_active_ms;
+    connection *prev;       // All of the worker's connections, for the idle sweep
+    connection *next;
+};
+
+static keyring_entry *keyring;
+static size_t keyring_size;
+static volatile sig_atomic_t stop_requested;
+
+// Set in each worker: its index, the shard count and the state of the
+// peers it owns (peer_id % shard_count == shard_index), at peer_id / shard_count
+static int shard_index;
+static int shard_count;
+static peer_state *peer_states;
+
+static void on_stop(int signum)
+{
+    (void)signum;
+    stop_requested = 1;
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*============================
+        Load keyring
+==============================*/
+static void load_keyring(char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("Error opening file: %s\n", filename);
+        exit(1);
+    }
+
+    size_t capacity = 64;
+    keyring = malloc(capacity * sizeof(keyring_entry));
+    keyring_size = 0;
+
+    char line[MAX_KEYRING_LINE];
+    char hex[MAX_KEYRING_LINE];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        int counter, nonce;
+        if (sscanf(line, "%s %d %d", hex, &counter, &nonce) != 3 || strlen(hex) % 2 != 0) {
+            printf("Error reading keyring line %zu: %s\n", keyring_size + 1, filename);
+            exit(1);
+        }
+        if (keyring_size == capacity) {
+            capacity *= 2;
+            keyring = realloc(keyring, capacity * sizeof(keyring_entry));
+        }
+        keyring_entry *entry = &keyring[keyring_size++];
+        entry->key_len = strlen(hex) / 2;
+        entry->key = malloc(entry->key_len > 0 ? entry->key_len : 1);
+        crp_from_hex(entry->key, hex, entry->key_len);
+        entry->counter = counter;
+        entry->nonce = nonce;
+    }
+    fclose(file);
+}
+
+/*============================
+        Open shard listener
+==============================*/
+static int open_listener(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        perror("socket");
+        exit(1);
+    }
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+        perror("SO_REUSEPORT");
+        exit(1);
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror("bind/listen");
+        exit(1);
+    }
+    return fd;
+}
+
+/*============================
+        Init peer state table
+==============================*/
+// Starts every peer this shard owns from its keyring entry
+static void init_peer_states(int shard, int shards)
+{
+    shard_index = shard;
+    shard_count = shards;
+    size_t owned = (keyring_size + shards - 1) / shards;
+    peer_states = calloc(owned > 0 ? owned : 1, sizeof(peer_state));
+    for (size_t peer = shard; peer < keyring_size; peer += shards) {
+        peer_state *state = &peer_states[peer / shards];
+        state->counter = keyring[peer].counter;
+        state->nonce = keyring[peer].nonce;
+    }
+}
+
+/*============================
+        Release peer
+==============================*/
+// Detaches the connection from its peer; a later MSG on it gets NO_HELLO
+static void release_peer(connection *conn)
+{
+    if (conn->peer < 0) {
+        return;
+    }
+    if (conn->state->holder == conn) {
+        conn->state->holder = NULL;
+        conn->state->verified = 0;
+    }
+    if (conn->mode == CRP_WIRE_SESSION) {
+        crp_session_free(&conn->session);
+    }
+    conn->peer = -1;
+    conn->state = NULL;
+}
+
+/*============================
+        Handle HELLO
+==============================*/
+// Sets *owner to the owning shard when the answer is WRONG_SHARD. HELLO is
+// not authenticated, so it only holds the peer until a MSG verifies: until
+// then a newer HELLO for the same peer takes it over.
+static unsigned char handle_hello(connection *conn, int *owner)
+{
+    if (conn->peer >= 0) {
+        return CRP_WIRE_DUPLICATE_HELLO;
+    }
+
+    int mode = conn->in[1];
+    uint32_t peer = crp_wire_get_u32(conn->in + 4);
+    if (mode != CRP_WIRE_LEGACY && mode != CRP_WIRE_SESSION) {
+        return CRP_WIRE_BAD_FRAME;
+    }
+    if (peer >= keyring_size) {
+        return CRP_WIRE_UNKNOWN_PEER;
+    }
+    if ((int)(peer % shard_count) != shard_index) {
+        *owner = (int)(peer % shard_count);
+        return CRP_WIRE_WRONG_SHARD;
+    }
+
+    peer_state *state = &peer_states[peer / shard_count];
+    if (state->holder != NULL && state->verified) {
+        return CRP_WIRE_PEER_BUSY;
+    }
+
+    keyring_entry *entry = &keyring[peer];
+    if (mode == CRP_WIRE_SESSION &&
+        !crp_session_init(&conn->session, entry->key, entry->key_len, state->counter, state->nonce)) {
+        return CRP_WIRE_SERVER_ERROR;
+    }
+    if (state->holder != NULL) {
+        release_peer(state->holder);
+    }
+    conn->mode = mode;
+    conn->state = state;
+    conn->peer = peer;
+    state->holder = conn;
+    return CRP_WIRE_OK;
+}
+
+/*============================
+        Handle MSG
+==============================*/
+static unsigned char handle_msg(connection *conn, unsigned char response[HASH_SIZE])
+{
+    if (conn->peer < 0) {
+        return CRP_WIRE_NO_HELLO;
+    }
+
+    const unsigned char *ciphertext = conn->in + 4;
+    const unsigned char *signature = conn->in + 4 + MESSAGE_SIZE;
+    unsigned char message[MESSAGE_SIZE];
+    peer_state *state = conn->state;
+    int verified;
+    if (conn->mode == CRP_WIRE_SESSION) {
+        verified = crp_session_bob_process(&conn->session, state->counter, state->nonce,
+                                           ciphertext, signature, message, response);
+    } else {
+        keyring_entry *entry = &keyring[conn->peer];
+        verified = crp_bob_process(entry->key, entry->key_len, state->counter, state->nonce,
+                                   ciphertext, signature, message, response);
+    }
+    if (verified == CRP_SESSION_ERROR) {
+        return CRP_WIRE_SERVER_ERROR;
+    }
+    if (!verified) {
+        return CRP_WIRE_SIG_FAILED;
+    }
+
+    // Same state update as bob.c writing back B_ctr/B_nonce
+    state->counter++;
+    state->nonce++;
+    state->verified = 1;   // From now on the peer is busy until this connection closes
+    return CRP_WIRE_OK;
+}
+
+/*============================
+        Close connection
+==============================*/
+static void close_connection(connection **list, connection *conn)
+{
+    release_peer(conn);   // The peer may connect again
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        *list = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+    close(conn->fd);
+    free(conn);
+}
+
+/*============================
+        Shard worker
+==============================*/
+static void run_worker(int shard, int shards, int cpu, int listener, int direct_listener)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        perror("sched_setaffinity");
+    }
+
+    init_peer_states(shard, shards);
+
+    // Listeners are told apart from connections by their address
+    int epfd = epoll_create1(0);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listener;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &ev);
+    ev.data.ptr = &direct_listener;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, direct_listener, &ev);
+
+    unsigned long handshakes = 0, rejected = 0, connections = 0, redirected = 0, timed_out = 0;
+    struct epoll_event events[MAX_EVENTS];
+    connection *open_connections = NULL;
+    uint64_t next_sweep_ms = now_ms() + IDLE_TIMEOUT_MS;
+
+    while (!stop_requested) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, 200);
+        uint64_t now = now_ms();
+        for (int e = 0; e < n; e++) {
+            connection *conn = events[e].data.ptr;
+
+            if (events[e].data.ptr == &listener || events[e].data.ptr == &direct_listener) {
+                int accepting = *(int*)events[e].data.ptr;
+                int fd;
+                while ((fd = accept4(accepting, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+                    int one = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    connection *c = calloc(1, sizeof(connection));
+                    c->fd = fd;
+                    c->peer = -1;
+                    c->last_active_ms = now;
+                    c->next = open_connections;
+                    if (open_connections != NULL) {
+                        open_connections->prev = c;
+                    }
+                    open_connections = c;
+                    ev.events = EPOLLIN;
+                    ev.data.ptr = c;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+                    connections++;
+                }
+                continue;
+            }
+
+            // Read as many complete frames as are available
+            conn->last_active_ms = now;
+            int closed = 0;
+            for (;;) {
+                size_t need = conn->have == 0 ? 1 : crp_wire_request_len(conn->in[0]);
+                if (need == 0) {
+                    closed = 1;   // Unknown frame type, drop the peer
+                    break;
+                }
+                ssize_t got = read(conn->fd, conn->in + conn->have, need - conn->have);
+                if (got == 0 || (got < 0 && errno != EAGAIN && errno != EINTR)) {
+                    closed = 1;
+                    break;
+                }
+                if (got < 0) {
+                    break;
+                }
+                conn->have += got;
+                if (conn->have == 1 || conn->have < crp_wire_request_len(conn->in[0])) {
+                    continue;
+                }
+
+                unsigned char reply[CRP_WIRE_MSG_REPLY_LEN] = {0};
+                size_t reply_len;
+                if (conn->in[0] == CRP_WIRE_HELLO) {
+                    int owner = shard;
+                    reply[1] = handle_hello(conn, &owner);
+                    reply[3] = (unsigned char)owner;
+                    reply_len = CRP_WIRE_HELLO_REPLY_LEN;
+                    if (reply[1] == CRP_WIRE_WRONG_SHARD) {
+                        redirected++;
+                    }
+                } else {
+                    reply[1] = handle_msg(conn, reply + 4);
+                    reply_len = CRP_WIRE_MSG_REPLY_LEN;
+                    if (reply[1] == CRP_WIRE_OK) {
+                        handshakes++;
+                    } else {
+                        rejected++;
+                    }
+                }
+                reply[0] = conn->in[0];
+                reply[2] = (unsigned char)shard;
+                conn->have = 0;
+
+                // Clients wait for each reply, so it always fits the send buffer
+                if (write(conn->fd, reply, reply_len) != (ssize_t)reply_len) {
+                    closed = 1;
+                    break;
+                }
+            }
+            if (closed) {
+                epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+                close_connection(&open_connections, conn);
+            }
+        }
+
+        // Idle connections are closed between batches, never while one of
+        // their events is still pending in 'events'
+        if (now >= next_sweep_ms) {
+            connection *c = open_connections;
+            while (c != NULL) {
+                connection *next = c->next;
+                if (now - c->last_active_ms >= IDLE_TIMEOUT_MS) {
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+                    close_connection(&open_connections, c);
+                    timed_out++;
+                }
+                c = next;
+            }
+            next_sweep_ms = now + IDLE_TIMEOUT_MS / 10;
+        }
+    }
+
+    printf("Shard %d (cpu %d): %lu handshakes, %lu rejected, %lu connections, %lu redirected, %lu timed out\n",
+           shard, cpu, handshakes, rejected, connections, redirected, timed_out);
+    fflush(stdout);
+    exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 4) {
+        printf("Usage: %s <keyring_file> [port] [workers]\n", argv[0]);
+        return 1;
+    }
+
+    load_keyring(argv[1]);
+    // Fetched once here and inherited by every worker
+    if (!crp_crypto_init(CRP_ALG_SHA256 | CRP_ALG_HMAC | CRP_ALG_HKDF, 0)) {
+        printf("OpenSSL does not provide SHA-256/HMAC/HKDF\n");
+        return 1;
+    }
+    int port = argc > 2 ? atoi(argv[2]) : DEFAULT_PORT;
+
+    // Workers are pinned round-robin over the CPUs this process may use
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    int cpus[CPU_SETSIZE];
+    int cpu_count = 0;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &allowed)) {
+            cpus[cpu_count++] = c;
+        }
+    }
+    int workers = argc > 3 ? atoi(argv[3]) : cpu_count;
+    if (port <= 0 || workers < 1 || workers > 255 || port + workers > 65535) {
+        printf("Workers must be 1-255 and port + workers at most 65535\n");
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // Every shard's socket joins the SO_REUSEPORT group before any worker
+    // starts, so the kernel balances across all of them from the first connection
+    int *listeners = malloc(2 * workers * sizeof(int));
+    for (int i = 0; i < workers; i++) {
+        listeners[i] = open_listener(port);
+    }
+    // Directed listeners, where WRONG_SHARD sends a peer to its owner
+    for (int i = 0; i < workers; i++) {
+        listeners[workers + i] = open_listener(port + 1 + i);
+    }
+
+    pid_t *pids = malloc(workers * sizeof(pid_t));
+    for (int i = 0; i < workers; i++) {
+        fflush(stdout);
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pids[i] == 0) {
+            for (int j = 0; j < workers; j++) {
+                if (j != i) {
+                    close(listeners[j]);
+                    close(listeners[workers + j]);
+                }
+            }
+            run_worker(i, workers, cpus[i % cpu_count], listeners[i], listeners[workers + i]);
+        }
+    }
+    printf("Bob server: %d shard(s) on 127.0.0.1:%d (direct %d-%d), %zu peer(s)\n",
+           workers, port, port + 1, port + workers, keyring_size);
+    fflush(stdout);
+
+    // Wait until asked to stop or a worker dies, then stop every worker
+    int failed = 0;
+    while (!stop_requested) {
+        pid_t pid = waitpid(-1, NULL, 0);
+        if (pid > 0) {
+            printf("Bob server: a shard exited unexpectedly, stopping\n");
+            for (int i = 0; i < workers; i++) {
+                if (pids[i] == pid) {
+                    pids[i] = 0;
+                }
+            }
+            failed = 1;
+            break;
+        }
+    }
+    for (int i = 0; i < workers; i++) {
+        if (pids[i] > 0) {
+            kill(pids[i], SIGTERM);
+        }
+    }
+    while (wait(NULL) > 0) {
+    }
+
+    for (int i = 0; i < 2 * workers; i++) {
+        close(listeners[i]);
+    }
+    free(listeners);
+    free(pids);
+    return failed;
+}
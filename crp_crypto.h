@@ -0,0 +1,288 @@
+/**************************
+ *      Crypto Setup        *
+ **************************
+ *
+ * One-time OpenSSL setup shared by every program in this repository.
+ *
+ * With OpenSSL 3, calls such as SHA256(), HMAC(EVP_sha256(), ...) or
+ * EVP_get_digestbyname() resolve the algorithm through the provider on
+ * every call, and helpers that create a fresh EVP_*_CTX per call pay for
+ * the allocation and setup again. crp_crypto_init() fetches the algorithms
+ * a program needs once (EVP_MD_fetch / EVP_MAC_fetch / EVP_CIPHER_fetch /
+ * EVP_KDF_fetch), and the helpers below reuse one context per thread:
+ * crp_sha256 runs on a per-thread EVP_MD_CTX and crp_hmac_sha256 on a
+ * per-thread EVP_MAC_CTX with HMAC-SHA256 selected once, re-keyed per call.
+ *
+ * The very first fetch in a process still costs about 2 ms (provider and
+ * config loading). For one-handshake processes such as alice and bob,
+ * linking libcrypto statically removes most of the remaining load cost (see
+ * the README). Defining CRP_SHA256_LOWLEVEL instead switches crp_sha256 and
+ * crp_hmac_sha256 to OpenSSL's deprecated SHA256_* functions and an RFC 2104
+ * HMAC built on them, which need no provider at all; that build uses no
+ * EVP context for SHA-256 or HMAC and is opt-in only.
+ *
+ * Only the algorithms named in crp_crypto_init() are fetched up front;
+ * fetching ones a program never uses would make start-up slower. Anything
+ * not fetched up front is fetched on first use, which is safe in
+ * single-threaded programs. Multi-threaded programs must call
+ * crp_crypto_init() for everything they use before starting threads.
+ *
+ * Short-lived programs (alice, bob) pass CRP_INIT_SHORT_LIVED to skip
+ * OpenSSL's teardown of its algorithm stores at exit; the process is about
+ * to end and the OS reclaims that memory anyway.
+ *
+ * Requires OpenSSL 3.0 or later.
+ *
+ */
+
+#ifndef CRP_CRYPTO_H
+#define CRP_CRYPTO_H
+
+#include <stdio.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#include <openssl/sha.h>
+
+#if defined(CRP_SHA256_LOWLEVEL) && defined(OPENSSL_NO_DEPRECATED_3_0)
+#error "CRP_SHA256_LOWLEVEL needs the SHA256_* functions this OpenSSL was built without"
+#endif
+
+// Algorithms for crp_crypto_init()
+#define CRP_ALG_SHA256    0x01   // crp_sha256 / crp_hmac_sha256 (no fetch with CRP_SHA256_LOWLEVEL)
+#define CRP_ALG_HMAC      0x02   // Keyed HMAC-SHA256 contexts, crp_hmac_sha256_ctx_new
+#define CRP_ALG_BLAKE2S   0x04
+#define CRP_ALG_CHACHA20  0x08
+#define CRP_ALG_HKDF      0x10
+
+// Flags for crp_crypto_init()
+#define CRP_INIT_SHORT_LIVED 0x01
+
+typedef struct {
+    EVP_MD *sha256;
+    EVP_MD *blake2s;
+    EVP_MAC *hmac;
+    EVP_CIPHER *chacha20;
+    EVP_KDF *hkdf;
+} crp_algorithms;
+
+typedef struct {
+    EVP_MD_CTX *md_ctx;
+    EVP_MAC_CTX *hmac_ctx;       // HMAC with SHA-256 selected once
+    EVP_CIPHER_CTX *cipher_ctx;
+} crp_contexts;
+
+// Fetched once per process, shared by all threads (EVP_MD etc. are read-only)
+static crp_algorithms crp_alg;
+// Reused by every call on the same thread
+static _Thread_local crp_contexts crp_ctx;
+
+/*============================
+        Algorithm handles
+==============================*/
+// Each returns the cached handle, fetching it on first use (NULL on failure)
+static inline EVP_MD* crp_md_sha256(void)
+{
+    if (crp_alg.sha256 == NULL) crp_alg.sha256 = EVP_MD_fetch(NULL, "SHA256", NULL);
+    return crp_alg.sha256;
+}
+
+static inline EVP_MD* crp_md_blake2s(void)
+{
+    if (crp_alg.blake2s == NULL) crp_alg.blake2s = EVP_MD_fetch(NULL, "BLAKE2s256", NULL);
+    return crp_alg.blake2s;
+}
+
+static inline EVP_MAC* crp_mac_hmac(void)
+{
+    if (crp_alg.hmac == NULL) crp_alg.hmac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+    return crp_alg.hmac;
+}
+
+static inline EVP_CIPHER* crp_cipher_chacha20(void)
+{
+    if (crp_alg.chacha20 == NULL) crp_alg.chacha20 = EVP_CIPHER_fetch(NULL, "ChaCha20", NULL);
+    return crp_alg.chacha20;
+}
+
+static inline EVP_KDF* crp_kdf_hkdf(void)
+{
+    if (crp_alg.hkdf == NULL) crp_alg.hkdf = EVP_KDF_fetch(NULL, "HKDF", NULL);
+    return crp_alg.hkdf;
+}
+
+/*============================
+        HMAC-SHA256 context
+==============================*/
+// New HMAC context with SHA-256 already selected, so later EVP_MAC_init()
+// calls only need a key. Caller frees with EVP_MAC_CTX_free().
+static inline EVP_MAC_CTX* crp_hmac_sha256_ctx_new(void)
+{
+    EVP_MAC *hmac = crp_mac_hmac();
+    EVP_MAC_CTX *ctx = hmac != NULL ? EVP_MAC_CTX_new(hmac) : NULL;
+    if (ctx == NULL) {
+        return NULL;
+    }
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0),
+        OSSL_PARAM_construct_end()
+    };
+    if (EVP_MAC_CTX_set_params(ctx, params) != 1) {
+        EVP_MAC_CTX_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/*============================
+        Explicit init phase
+==============================*/
+// Fetches the CRP_ALG_* algorithms in 'algorithms'. Returns 1 on success,
+// 0 if any of them is unavailable.
+static inline int crp_crypto_init(unsigned int algorithms, unsigned int flags)
+{
+    if (flags & CRP_INIT_SHORT_LIVED) {
+        OPENSSL_init_crypto(OPENSSL_INIT_NO_ATEXIT, NULL);
+    }
+
+    int ok = 1;
+#ifndef CRP_SHA256_LOWLEVEL
+    if (algorithms & CRP_ALG_SHA256) algorithms |= CRP_ALG_HMAC;
+#endif
+    if (algorithms & CRP_ALG_HMAC)     ok &= crp_md_sha256() != NULL && crp_mac_hmac() != NULL;
+    if (algorithms & CRP_ALG_BLAKE2S)  ok &= crp_md_blake2s() != NULL;
+    if (algorithms & CRP_ALG_CHACHA20) ok &= crp_cipher_chacha20() != NULL;
+    if (algorithms & CRP_ALG_HKDF)     ok &= crp_kdf_hkdf() != NULL;
+    return ok;
+}
+
+/*============================
+        Digest with cached handle
+==============================*/
+// Returns 1 on success
+static inline int crp_digest(EVP_MD *md, const void *data, size_t len, unsigned char *out)
+{
+    if (crp_ctx.md_ctx == NULL) crp_ctx.md_ctx = EVP_MD_CTX_new();
+    unsigned int out_len;
+    return md != NULL && crp_ctx.md_ctx != NULL &&
+           EVP_DigestInit_ex2(crp_ctx.md_ctx, md, NULL) == 1 &&
+           EVP_DigestUpdate(crp_ctx.md_ctx, data, len) == 1 &&
+           EVP_DigestFinal_ex(crp_ctx.md_ctx, out, &out_len) == 1;
+}
+
+
+static inline int crp_blake2s(const void *data, size_t len, unsigned char out[32])
+{
+    return crp_digest(crp_md_blake2s(), data, len, out);
+}
+
+/*============================
+        SHA-256 / HMAC-SHA256
+==============================*/
+// Both return 1 on success
+#ifndef CRP_SHA256_LOWLEVEL
+
+static inline int crp_sha256(const void *data, size_t len, unsigned char out[32])
+{
+    return crp_digest(crp_md_sha256(), data, len, out);
+}
+
+static inline int crp_hmac_sha256(const unsigned char *key, size_t key_len,
+                                  const unsigned char *data, size_t data_len,
+                                  unsigned char out[32])
+{
+    if (crp_ctx.hmac_ctx == NULL) crp_ctx.hmac_ctx = crp_hmac_sha256_ctx_new();
+    // EVP_MAC_init() treats a NULL key as "reuse the previous key"
+    static const unsigned char empty_key[1];
+    size_t out_len;
+    return crp_ctx.hmac_ctx != NULL &&
+           EVP_MAC_init(crp_ctx.hmac_ctx, key_len > 0 ? key : empty_key, key_len, NULL) == 1 &&
+           EVP_MAC_update(crp_ctx.hmac_ctx, data, data_len) == 1 &&
+           EVP_MAC_final(crp_ctx.hmac_ctx, out, &out_len, 32) == 1;
+}
+
+#else
+
+// Opt-in (CRP_SHA256_LOWLEVEL): the SHA256_* functions are deprecated in
+// OpenSSL 3 in favour of EVP, but are the only SHA-256 that skips provider setup
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+static inline int crp_sha256(const void *data, size_t len, unsigned char out[32])
+{
+    SHA256_CTX ctx;
+    int ok = SHA256_Init(&ctx) && SHA256_Update(&ctx, data, len) && SHA256_Final(out, &ctx);
+    OPENSSL_cleanse(&ctx, sizeof(ctx));
+    return ok;
+}
+
+// HMAC per RFC 2104: H((K ^ opad) || H((K ^ ipad) || data))
+static inline int crp_hmac_sha256(const unsigned char *key, size_t key_len,
+                                  const unsigned char *data, size_t data_len,
+                                  unsigned char out[32])
+{
+    unsigned char block_key[SHA256_CBLOCK] = {0};
+    if (key_len > SHA256_CBLOCK) {
+        crp_sha256(key, key_len, block_key);
+    } else if (key_len > 0) {
+        memcpy(block_key, key, key_len);
+    }
+
+    unsigned char pad[SHA256_CBLOCK];
+    unsigned char inner[SHA256_DIGEST_LENGTH];
+    SHA256_CTX ctx;
+    for (int i = 0; i < SHA256_CBLOCK; i++) {
+        pad[i] = block_key[i] ^ 0x36;
+    }
+    int ok = SHA256_Init(&ctx) && SHA256_Update(&ctx, pad, SHA256_CBLOCK) &&
+             SHA256_Update(&ctx, data, data_len) && SHA256_Final(inner, &ctx);
+    for (int i = 0; i < SHA256_CBLOCK; i++) {
+        pad[i] = block_key[i] ^ 0x5c;
+    }
+    ok = ok && SHA256_Init(&ctx) && SHA256_Update(&ctx, pad, SHA256_CBLOCK) &&
+         SHA256_Update(&ctx, inner, sizeof(inner)) && SHA256_Final(out, &ctx);
+
+    OPENSSL_cleanse(block_key, sizeof(block_key));
+    OPENSSL_cleanse(pad, sizeof(pad));
+    OPENSSL_cleanse(inner, sizeof(inner));
+    OPENSSL_cleanse(&ctx, sizeof(ctx));
+    return ok;
+}
+
+#pragma GCC diagnostic pop
+
+#endif // CRP_SHA256_LOWLEVEL
+
+/*============================
+        ChaCha20 keystream with cached context
+==============================*/
+// Writes 'len' keystream bytes for a 32-byte key and 16-byte IV (4 counter,
+// 12 nonce). Returns 1 on success.
+static inline int crp_chacha20_keystream(const unsigned char key[32], const unsigned char iv[16],
+                                         unsigned char *out, size_t len)
+{
+    if (crp_ctx.cipher_ctx == NULL) crp_ctx.cipher_ctx = EVP_CIPHER_CTX_new();
+    EVP_CIPHER *chacha20 = crp_cipher_chacha20();
+    if (crp_ctx.cipher_ctx == NULL || chacha20 == NULL ||
+        EVP_EncryptInit_ex2(crp_ctx.cipher_ctx, chacha20, key, iv, NULL) != 1) {
+        return 0;
+    }
+
+    // Encrypting zeros yields the keystream; done in chunks to bound the stack
+    static const unsigned char zeros[256];
+    while (len > 0) {
+        int chunk = len < sizeof(zeros) ? (int)len : (int)sizeof(zeros);
+        int out_len;
+        if (EVP_EncryptUpdate(crp_ctx.cipher_ctx, out, &out_len, zeros, chunk) != 1) {
+            return 0;
+        }
+        out += out_len;
+        len -= out_len;
+    }
+    return 1;
+}
+
+#endif // CRP_CRYPTO_H
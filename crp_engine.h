@@ -0,0 +1,158 @@
+/**************************
+ *      Protocol Engine        *
+ **************************
+ *
+ * The per-message computations of the Challenge-Response Protocol, with no
+ * file I/O, so they can be shared by alice.c, bob.c and tools that drive
+ * many handshakes in one process (e.g. replay.c).
+ *
+ *   Alice:  c = m ⊕ H(k||ctr),  sig = HMAC_k(c||nonce)
+ *   Bob:    verify sig, m = c ⊕ H(k||ctr),  response = H(m||(ctr+1)||(nonce+1))
+ *
+ * Hashing and HMAC go through the cached algorithm handles and per-thread
+ * contexts of crp_crypto.h; call crp_crypto_init() once at start-up. Those
+ * can fail (e.g. a fetch or allocation), so every function here reports it
+ * and its outputs must not be used when it does.
+ *
+ * MESSAGE_SIZE and HASH_SIZE default to 32 and may be defined by the
+ * including file before this header.
+ *
+ */
+
+#ifndef CRP_ENGINE_H
+#define CRP_ENGINE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "crp_crypto.h"
+#include "crp_kernels.h"
+
+#ifndef HASH_SIZE
+#define HASH_SIZE 32
+#endif
+#ifndef MESSAGE_SIZE
+#define MESSAGE_SIZE 32
+#endif
+
+// k||ctr is built on the stack for keys up to this length, heap otherwise
+#define CRP_STACK_KEY_MAX 256
+
+// crp_bob_process() / crp_alice_verify() result when OpenSSL or an
+// allocation fails, as opposed to a check that does not pass (0)
+#define CRP_ENGINE_ERROR (-1)
+
+/*============================
+        Pad: H(k||ctr)
+==============================*/
+// Returns 1 on success, 0 on failure
+static inline int crp_key_counter_hash(const unsigned char *key, size_t key_len, int counter,
+                                       unsigned char pad[HASH_SIZE])
+{
+    // crp_format_dec() also writes a terminator, hence the + 1
+    unsigned char stack_buf[CRP_STACK_KEY_MAX + CRP_MAX_DEC_LEN + 1];
+    unsigned char *key_counter = stack_buf;
+    if (key_len > CRP_STACK_KEY_MAX) {
+        key_counter = malloc(key_len + CRP_MAX_DEC_LEN + 1);
+        if (key_counter == NULL) {
+            return 0;
+        }
+    }
+
+    memcpy(key_counter, key, key_len);
+    size_t counter_len = crp_format_dec(counter, (char*)key_counter + key_len);
+    int ok = crp_sha256(key_counter, key_len + counter_len, pad);
+
+    if (key_counter != stack_buf) {
+        free(key_counter);
+    }
+    return ok;
+}
+
+/*============================
+        Signature: HMAC_k(c||nonce)
+==============================*/
+// Returns 1 on success, 0 on failure
+static inline int crp_sign(const unsigned char *key, size_t key_len, int nonce,
+                           const unsigned char ciphertext[MESSAGE_SIZE],
+                           unsigned char signature[HASH_SIZE])
+{
+    unsigned char cipher_nonce[CRP_BLOCK_DEC_MAX(MESSAGE_SIZE)];
+    size_t cipher_nonce_len = CRP_KERNEL(pack_dec, MESSAGE_SIZE)(cipher_nonce, ciphertext, nonce);
+    return crp_hmac_sha256(key, key_len, cipher_nonce, cipher_nonce_len, signature);
+}
+
+/*============================
+        Response: H(m||(ctr+1)||(nonce+1))
+==============================*/
+// Returns 1 on success, 0 on failure
+static inline int crp_response(const unsigned char message[MESSAGE_SIZE], int counter, int nonce,
+                               unsigned char response[HASH_SIZE])
+{
+    unsigned char msg_ctr_nonce[CRP_BLOCK_DEC2_MAX(MESSAGE_SIZE)];
+    size_t msg_ctr_nonce_len = CRP_KERNEL(pack_dec2, MESSAGE_SIZE)(msg_ctr_nonce, message, counter + 1, nonce + 1);
+    return crp_sha256(msg_ctr_nonce, msg_ctr_nonce_len, response);
+}
+
+/*============================
+        Alice: build challenge
+==============================*/
+// Returns 1 on success, 0 if the pad or signature could not be computed
+static inline int crp_alice_challenge(const unsigned char *key, size_t key_len, int counter, int nonce,
+                                      const unsigned char message[MESSAGE_SIZE],
+                                      unsigned char ciphertext[MESSAGE_SIZE],
+                                      unsigned char signature[HASH_SIZE])
+{
+    unsigned char pad[HASH_SIZE];
+    if (!crp_key_counter_hash(key, key_len, counter, pad)) {
+        return 0;
+    }
+    CRP_KERNEL(xor, MESSAGE_SIZE)(ciphertext, message, pad);
+    return crp_sign(key, key_len, nonce, ciphertext, signature);
+}
+
+/*============================
+        Alice: check Bob's response
+==============================*/
+// Returns 1 if Bob's response matches H(m||(ctr+1)||(nonce+1)), 0 if it
+// does not, and CRP_ENGINE_ERROR if the expected response could not be computed
+static inline int crp_alice_verify(const unsigned char message[MESSAGE_SIZE], int counter, int nonce,
+                                   const unsigned char bob_response[HASH_SIZE])
+{
+    unsigned char expected_response[HASH_SIZE];
+    if (!crp_response(message, counter, nonce, expected_response)) {
+        return CRP_ENGINE_ERROR;
+    }
+    return CRP_KERNEL(equal, HASH_SIZE)(bob_response, expected_response);
+}
+
+/*============================
+        Bob: process challenge
+==============================*/
+// Returns 1 and fills message/response if the signature verifies, 0 if it
+// does not, and CRP_ENGINE_ERROR if the MAC, pad or response could not be computed
+static inline int crp_bob_process(const unsigned char *key, size_t key_len, int counter, int nonce,
+                                  const unsigned char ciphertext[MESSAGE_SIZE],
+                                  const unsigned char signature[HASH_SIZE],
+                                  unsigned char message[MESSAGE_SIZE],
+                                  unsigned char response[HASH_SIZE])
+{
+    unsigned char expected_signature[HASH_SIZE];
+    if (!crp_sign(key, key_len, nonce, ciphertext, expected_signature)) {
+        return CRP_ENGINE_ERROR;
+    }
+    if (!CRP_KERNEL(equal, HASH_SIZE)(signature, expected_signature)) {
+        return 0;
+    }
+
+    unsigned char pad[HASH_SIZE];
+    if (!crp_key_counter_hash(key, key_len, counter, pad)) {
+        return CRP_ENGINE_ERROR;
+    }
+    CRP_KERNEL(xor, MESSAGE_SIZE)(message, ciphertext, pad);
+    if (!crp_response(message, counter, nonce, response)) {
+        return CRP_ENGINE_ERROR;
+    }
+    return 1;
+}
+
+#endif // CRP_ENGINE_H
@@ -0,0 +1,251 @@
+/**************************
+ *      Fixed-Width Kernels        *
+ **************************
+ *
+ * Header-only helpers specialized at compile time on the message and digest
+ * widths used by the Challenge-Response Protocol (32 bytes for SHA-256 /
+ * BLAKE2s, 64 bytes for SHA-512 / BLAKE2b).
+ *
+ * Every width gets its own set of functions from CRP_DEFINE_WIDTH_KERNELS(N),
+ * so the loop bounds are constants the compiler can unroll. xor and equal
+ * work on 8-byte words (N/8 iterations, fully unrolled); the hex conversions
+ * are byte loops of N iterations, which GCC unrolls 16 at a time rather than
+ * fully to keep the code small. Callers pick a width with CRP_KERNEL():
+ *
+ *     CRP_KERNEL(xor, MESSAGE_SIZE)(ciphertext, message, pad);
+ *
+ * expands to crp_xor_32(...) and fails to compile for a width that has no
+ * kernels. Code that only knows the width at run time can use the crp_xor(),
+ * crp_equal() and crp_to_hex() dispatchers instead.
+ *
+ * Decimal counters/nonces are formatted with crp_format_dec(), which produces
+ * the same bytes as sprintf("%d") without going through stdio.
+ *
+ */
+
+#ifndef CRP_KERNELS_H
+#define CRP_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Longest "%d" rendering of an int: "-2147483648"
+#define CRP_MAX_DEC_LEN 11
+
+// Sizes of the fixed-layout buffers for block||dec and block||dec||dec
+#define CRP_BLOCK_DEC_MAX(N)  ((N) + CRP_MAX_DEC_LEN)
+#define CRP_BLOCK_DEC2_MAX(N) ((N) + 2 * CRP_MAX_DEC_LEN)
+
+// CRP_KERNEL(xor, 32) -> crp_xor_32 (the extra level expands macro widths)
+#define CRP_KERNEL_NAME(op, N) crp_##op##_##N
+#define CRP_KERNEL(op, N) CRP_KERNEL_NAME(op, N)
+
+// Enough for the word loops of every width; the byte loops unroll partially
+#if defined(__GNUC__) && !defined(__clang__)
+#define CRP_UNROLL _Pragma("GCC unroll 16")
+#elif defined(__clang__)
+#define CRP_UNROLL _Pragma("clang loop unroll(full)")
+#else
+#define CRP_UNROLL
+#endif
+
+static const char crp_hex_digits[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+/*============================
+        Hex digit value
+==============================*/
+// Returns 0-15 for a hex digit, -1 otherwise
+static inline int crp_hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/*============================
+        Hex pair to byte
+==============================*/
+// Same result as (unsigned char)strtol() on the two-character string in the
+// C locale, for any input: leading white space is skipped, a sign applies,
+// and parsing stops at the first non-hex character.
+static inline unsigned char crp_hex_pair(char hi, char lo)
+{
+    int h = crp_hex_value(hi);
+    int l = crp_hex_value(lo);
+    if (h < 0) {
+        if (l < 0) return 0;
+        if (hi == '-') return (unsigned char)-l;
+        if (hi == '+' || hi == ' ' || (hi >= '\t' && hi <= '\r')) return (unsigned char)l;
+        return 0;
+    }
+    if (l < 0) return (unsigned char)h;
+    return (unsigned char)((h << 4) | l);
+}
+
+/*============================
+        Decimal formatting
+==============================*/
+// Writes value as "%d" would (no terminator needed, one is added anyway).
+// 'out' must hold CRP_MAX_DEC_LEN + 1 bytes. Returns the number of digits.
+static inline size_t crp_format_dec(int value, char *out)
+{
+    char tmp[CRP_MAX_DEC_LEN];
+    size_t n = 0;
+    // Work in unsigned so INT_MIN does not overflow on negation
+    unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+
+    do {
+        tmp[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+
+    size_t len = 0;
+    if (value < 0) out[len++] = '-';
+    while (n > 0) out[len++] = tmp[--n];
+    out[len] = '\0';
+    return len;
+}
+
+/*============================
+        Width-specialized kernels
+==============================*/
+/*
+    For a width N this defines:
+    crp_xor_N(out, a, b)              out = a XOR b
+    crp_equal_N(a, b)                 1 if equal, 0 otherwise (constant time)
+    crp_to_hex_N(out, in)             2N lowercase hex chars + '\0'
+    crp_from_hex_N(out, hex)          2N hex chars -> N bytes
+    crp_pack_dec_N(out, block, v)     out = block || dec(v), returns length
+    crp_pack_dec2_N(out, block, a, b) out = block || dec(a) || dec(b)
+    'out' for the pack functions is CRP_BLOCK_DEC_MAX(N) / CRP_BLOCK_DEC2_MAX(N) bytes.
+*/
+#define CRP_DEFINE_WIDTH_KERNELS(N)                                             \
+    typedef char crp_width_check_##N[((N) % 8 == 0) ? 1 : -1];                  \
+                                                                                \
+    static inline void crp_xor_##N(unsigned char *out, const unsigned char *a, \
+                                   const unsigned char *b)                     \
+    {                                                                           \
+        CRP_UNROLL                                                              \
+        for (size_t i = 0; i < (N); i += 8) {                                   \
+            uint64_t x, y;                                                      \
+            memcpy(&x, a + i, 8);                                               \
+            memcpy(&y, b + i, 8);                                               \
+            x ^= y;                                                             \
+            memcpy(out + i, &x, 8);                                             \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static inline int crp_equal_##N(const unsigned char *a,                    \
+                                    const unsigned char *b)                    \
+    {                                                                           \
+        uint64_t diff = 0;                                                      \
+        CRP_UNROLL                                                              \
+        for (size_t i = 0; i < (N); i += 8) {                                   \
+            uint64_t x, y;                                                      \
+            memcpy(&x, a + i, 8);                                               \
+            memcpy(&y, b + i, 8);                                               \
+            diff |= x ^ y;                                                      \
+        }                                                                       \
+        return diff == 0;                                                       \
+    }                                                                           \
+                                                                                \
+    static inline void crp_to_hex_##N(char *out, const unsigned char *in)      \
+    {                                                                           \
+        CRP_UNROLL                                                              \
+        for (size_t i = 0; i < (N); i++) {                                      \
+            out[2 * i] = crp_hex_digits[in[i] >> 4];                            \
+            out[2 * i + 1] = crp_hex_digits[in[i] & 0x0f];                      \
+        }                                                                       \
+        out[2 * (N)] = '\0';                                                    \
+    }                                                                           \
+                                                                                \
+    static inline void crp_from_hex_##N(unsigned char *out, const char *hex)   \
+    {                                                                           \
+        CRP_UNROLL                                                              \
+        for (size_t i = 0; i < (N); i++) {                                      \
+            out[i] = crp_hex_pair(hex[2 * i], hex[2 * i + 1]);                  \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static inline size_t crp_pack_dec_##N(unsigned char *out,                  \
+                                          const unsigned char *block, int v)   \
+    {                                                                           \
+        char dec[CRP_MAX_DEC_LEN + 1];                                          \
+        size_t n = crp_format_dec(v, dec);                                      \
+        memcpy(out, block, (N));                                                \
+        memcpy(out + (N), dec, n);                                              \
+        return (N) + n;                                                         \
+    }                                                                           \
+                                                                                \
+    static inline size_t crp_pack_dec2_##N(unsigned char *out,                 \
+                                           const unsigned char *block,         \
+                                           int v1, int v2)                     \
+    {                                                                           \
+        char dec[CRP_MAX_DEC_LEN + 1];                                          \
+        size_t n1 = crp_format_dec(v1, dec);                                    \
+        memcpy(out, block, (N));                                                \
+        memcpy(out + (N), dec, n1);                                             \
+        size_t n2 = crp_format_dec(v2, dec);                                    \
+        memcpy(out + (N) + n1, dec, n2);                                        \
+        return (N) + n1 + n2;                                                   \
+    }
+
+CRP_DEFINE_WIDTH_KERNELS(32)
+CRP_DEFINE_WIDTH_KERNELS(64)
+
+/*============================
+        Run-time width dispatch
+==============================*/
+// Widths without a specialization fall back to a plain loop.
+static inline void crp_xor(unsigned char *out, const unsigned char *a,
+                           const unsigned char *b, size_t width)
+{
+    switch (width) {
+        case 32: crp_xor_32(out, a, b); return;
+        case 64: crp_xor_64(out, a, b); return;
+    }
+    for (size_t i = 0; i < width; i++) out[i] = a[i] ^ b[i];
+}
+
+static inline int crp_equal(const unsigned char *a, const unsigned char *b,
+                            size_t width)
+{
+    switch (width) {
+        case 32: return crp_equal_32(a, b);
+        case 64: return crp_equal_64(a, b);
+    }
+    unsigned char diff = 0;
+    for (size_t i = 0; i < width; i++) diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+static inline void crp_to_hex(char *out, const unsigned char *in, size_t width)
+{
+    switch (width) {
+        case 32: crp_to_hex_32(out, in); return;
+        case 64: crp_to_hex_64(out, in); return;
+    }
+    for (size_t i = 0; i < width; i++) {
+        out[2 * i] = crp_hex_digits[in[i] >> 4];
+        out[2 * i + 1] = crp_hex_digits[in[i] & 0x0f];
+    }
+    out[2 * width] = '\0';
+}
+
+static inline void crp_from_hex(unsigned char *out, const char *hex, size_t width)
+{
+    switch (width) {
+        case 32: crp_from_hex_32(out, hex); return;
+        case 64: crp_from_hex_64(out, hex); return;
+    }
+    for (size_t i = 0; i < width; i++) {
+        out[i] = crp_hex_pair(hex[2 * i], hex[2 * i + 1]);
+    }
+}
+
+#endif // CRP_KERNELS_H
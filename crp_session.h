@@ -0,0 +1,238 @@
+/**************************
+ *      Session Keys        *
+ **************************
+ *
+ * Optional session mode: instead of hashing the full shared key on every
+ * message, both sides derive two 32-byte subkeys once with HKDF-SHA256
+ *
+ *   enc_key || mac_key = HKDF(k, salt = "ctr0:nonce0", info = "CRP session v1")
+ *
+ * from the shared key and the counter/nonce the session started at, and
+ * then run every message on the subkeys. "Once" is per crp_session: the
+ * one-shot alice and bob derive again in every process, so only long-lived
+ * users (bob_server per connection, replay per recorded session) save work:
+ *
+ *   c = m ⊕ H(enc_key||ctr),  sig = HMAC_mac_key(c||nonce)
+ *
+ * The HMAC context is keyed once, so each message only re-initializes it
+ * from the cached key state. The response H(m||(ctr+1)||(nonce+1)) is the
+ * same as in legacy mode.
+ *
+ * Negotiation: Alice proposes session mode by writing Session.txt
+ * ("hkdf-sha256 <ctr0> <nonce0>") when CRP_SESSION is set; both sides use
+ * session mode whenever that file is present and legacy mode otherwise, so
+ * the test_cases/ scenarios are unaffected.
+ *
+ * Requires OpenSSL 3.0 or later (EVP_KDF / EVP_MAC).
+ *
+ */
+
+#ifndef CRP_SESSION_H
+#define CRP_SESSION_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include "crp_crypto.h"
+#include "crp_engine.h"
+
+#define CRP_SESSION_FILE "Session.txt"
+#define CRP_SESSION_ENV "CRP_SESSION"
+#define CRP_SESSION_SCHEME "hkdf-sha256"
+#define CRP_SESSION_INFO "CRP session v1"
+#define CRP_SUBKEY_SIZE 32
+
+// crp_session_bob_process() result when OpenSSL fails, as opposed to a
+// signature that does not verify (0); the same value as crp_bob_process()'s
+#define CRP_SESSION_ERROR CRP_ENGINE_ERROR
+
+typedef struct {
+    int counter;                            // Counter/nonce the session was derived from
+    int nonce;
+    unsigned char enc_key[CRP_SUBKEY_SIZE];
+    EVP_MAC_CTX *mac_ctx;                   // Keyed with the MAC subkey once
+} crp_session;
+
+/*============================
+        Session requested?
+==============================*/
+static inline int crp_session_requested(void)
+{
+    const char *value = getenv(CRP_SESSION_ENV);
+    return value != NULL && value[0] != '\0' && strcmp(value, "0") != 0;
+}
+
+/*============================
+        Read Session.txt
+==============================*/
+// Returns 1 and fills counter/nonce if the file exists and is valid,
+// 0 if it does not exist, -1 if it is malformed or names another scheme.
+static inline int crp_session_load(const char *filename, int *counter, int *nonce)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    char scheme[32];
+    int ok = fscanf(file, "%31s %d %d", scheme, counter, nonce) == 3 &&
+             strcmp(scheme, CRP_SESSION_SCHEME) == 0;
+    fclose(file);
+    return ok ? 1 : -1;
+}
+
+/*============================
+        Write Session.txt
+==============================*/
+// Returns 1 on success, 0 if the file could not be written
+static inline int crp_session_store(const char *filename, int counter, int nonce)
+{
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    fprintf(file, "%s %d %d", CRP_SESSION_SCHEME, counter, nonce);
+    fclose(file);
+    return 1;
+}
+
+/*============================
+        Free session
+==============================*/
+static inline void crp_session_free(crp_session *session)
+{
+    OPENSSL_cleanse(session->enc_key, sizeof(session->enc_key));
+    EVP_MAC_CTX_free(session->mac_ctx);
+    memset(session, 0, sizeof(*session));
+}
+
+/*============================
+        Derive session subkeys
+==============================*/
+// Returns 1 on success, 0 on failure (session is left freed)
+static inline int crp_session_init(crp_session *session, const unsigned char *key, size_t key_len,
+                                   int counter, int nonce)
+{
+    memset(session, 0, sizeof(*session));
+    session->counter = counter;
+    session->nonce = nonce;
+
+    // salt = "ctr0:nonce0" (the separator keeps e.g. 1,55 and 15,5 apart)
+    char salt[2 * CRP_MAX_DEC_LEN + 2];
+    size_t salt_len = crp_format_dec(counter, salt);
+    salt[salt_len++] = ':';
+    salt_len += crp_format_dec(nonce, salt + salt_len);
+
+    unsigned char subkeys[2 * CRP_SUBKEY_SIZE];
+    int ok = 0;
+    EVP_KDF *kdf = crp_kdf_hkdf();
+    EVP_KDF_CTX *kdf_ctx = kdf != NULL ? EVP_KDF_CTX_new(kdf) : NULL;
+    if (kdf_ctx != NULL) {
+        OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, "SHA256", 0),
+            OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY, (void*)key, key_len),
+            OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT, salt, salt_len),
+            OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_INFO, CRP_SESSION_INFO,
+                                              strlen(CRP_SESSION_INFO)),
+            OSSL_PARAM_construct_end()
+        };
+        ok = EVP_KDF_derive(kdf_ctx, subkeys, sizeof(subkeys), params) == 1;
+    }
+    EVP_KDF_CTX_free(kdf_ctx);
+    if (!ok) {
+        return 0;
+    }
+
+    memcpy(session->enc_key, subkeys, CRP_SUBKEY_SIZE);
+
+    session->mac_ctx = crp_hmac_sha256_ctx_new();
+    ok = session->mac_ctx != NULL &&
+         EVP_MAC_init(session->mac_ctx, subkeys + CRP_SUBKEY_SIZE, CRP_SUBKEY_SIZE, NULL) == 1;
+
+    OPENSSL_cleanse(subkeys, sizeof(subkeys));
+    if (!ok) {
+        crp_session_free(session);
+    }
+    return ok;
+}
+
+/*============================
+        Session pad: H(enc_key||ctr)
+==============================*/
+// Returns 1 on success, 0 on failure
+static inline int crp_session_pad(crp_session *session, int counter, unsigned char pad[HASH_SIZE])
+{
+    unsigned char key_counter[CRP_SUBKEY_SIZE + CRP_MAX_DEC_LEN + 1];
+    memcpy(key_counter, session->enc_key, CRP_SUBKEY_SIZE);
+    size_t counter_len = crp_format_dec(counter, (char*)key_counter + CRP_SUBKEY_SIZE);
+    return crp_sha256(key_counter, CRP_SUBKEY_SIZE + counter_len, pad);
+}
+
+/*============================
+        Session signature: HMAC_mac_key(c||nonce)
+==============================*/
+// Returns 1 on success, 0 if the MAC could not be computed
+static inline int crp_session_sign(crp_session *session, int nonce,
+                                   const unsigned char ciphertext[MESSAGE_SIZE],
+                                   unsigned char signature[HASH_SIZE])
+{
+    unsigned char cipher_nonce[CRP_BLOCK_DEC_MAX(MESSAGE_SIZE)];
+    size_t cipher_nonce_len = CRP_KERNEL(pack_dec, MESSAGE_SIZE)(cipher_nonce, ciphertext, nonce);
+
+    // A NULL key restarts from the cached keyed state
+    size_t sig_len;
+    return EVP_MAC_init(session->mac_ctx, NULL, 0, NULL) == 1 &&
+           EVP_MAC_update(session->mac_ctx, cipher_nonce, cipher_nonce_len) == 1 &&
+           EVP_MAC_final(session->mac_ctx, signature, &sig_len, HASH_SIZE) == 1 &&
+           sig_len == HASH_SIZE;
+}
+
+/*============================
+        Alice: build challenge (session)
+==============================*/
+// Returns 1 on success, 0 if the pad or signature could not be computed
+static inline int crp_session_alice_challenge(crp_session *session, int counter, int nonce,
+                                              const unsigned char message[MESSAGE_SIZE],
+                                              unsigned char ciphertext[MESSAGE_SIZE],
+                                              unsigned char signature[HASH_SIZE])
+{
+    unsigned char pad[HASH_SIZE];
+    if (!crp_session_pad(session, counter, pad)) {
+        return 0;
+    }
+    CRP_KERNEL(xor, MESSAGE_SIZE)(ciphertext, message, pad);
+    return crp_session_sign(session, nonce, ciphertext, signature);
+}
+
+/*============================
+        Bob: process challenge (session)
+==============================*/
+// Returns 1 and fills message/response if the signature verifies, 0 if it
+// does not, and CRP_SESSION_ERROR if the MAC, pad or response could not be computed
+static inline int crp_session_bob_process(crp_session *session, int counter, int nonce,
+                                          const unsigned char ciphertext[MESSAGE_SIZE],
+                                          const unsigned char signature[HASH_SIZE],
+                                          unsigned char message[MESSAGE_SIZE],
+                                          unsigned char response[HASH_SIZE])
+{
+    unsigned char expected_signature[HASH_SIZE];
+    if (!crp_session_sign(session, nonce, ciphertext, expected_signature)) {
+        return CRP_SESSION_ERROR;
+    }
+    if (!CRP_KERNEL(equal, HASH_SIZE)(signature, expected_signature)) {
+        return 0;
+    }
+
+    unsigned char pad[HASH_SIZE];
+    if (!crp_session_pad(session, counter, pad)) {
+        return CRP_SESSION_ERROR;
+    }
+    CRP_KERNEL(xor, MESSAGE_SIZE)(message, ciphertext, pad);
+    if (!crp_response(message, counter, nonce, response)) {
+        return CRP_SESSION_ERROR;
+    }
+    return 1;
+}
+
+#endif // CRP_SESSION_H
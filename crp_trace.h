@@ -0,0 +1,237 @@
+/**************************
+ *      Session Trace        *
+ **************************
+ *
+ * Optional binary log of every handshake alice and bob perform, used to
+ * replay real traffic through the current engine (see replay.c).
+ *
+ * Tracing is enabled by setting CRP_TRACE to a file path; records are
+ * appended, so several alice/bob runs can share one trace. Each append holds
+ * an exclusive flock() on the file while it checks whether the header is
+ * needed and writes, so concurrent runs neither both write a header nor
+ * interleave records.
+ *
+ * A trace holds the raw shared keys, so it is as secret as SharedKey.txt.
+ * New traces are created with mode 0600; an existing file keeps its mode.
+ *
+ * File layout (all integers little-endian):
+ *   header:  "CRPTRACE" (8 bytes), version (u32)
+ *   record:  role (u8), status (u8), mode (u8), reserved (u8), key_len (u16),
+ *            counter (i32), nonce (i32), session_counter (i32),
+ *            session_nonce (i32), elapsed_ns (u64), message[32],
+ *            ciphertext[32], signature[32], response[32], key[key_len]
+ *
+ * 'elapsed_ns' is the engine time of the handshake in that one alice/bob
+ * process: the challenge, verification and response computations, without
+ * file I/O or session key derivation. Each process runs a single, cold
+ * handshake, so it is an upper bound rather than a steady-state figure.
+ *
+ * For Bob, 'message' is the decrypted message and 'response' the response he
+ * computed (both zero when the signature fails). For Alice, 'response' is the
+ * response she read from Response.txt (zero if there was none yet).
+ *
+ */
+
+#ifndef CRP_TRACE_H
+#define CRP_TRACE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#define CRP_TRACE_ENV "CRP_TRACE"
+#define CRP_TRACE_MAGIC "CRPTRACE"
+#define CRP_TRACE_VERSION 1
+#define CRP_TRACE_BLOCK 32
+#define CRP_TRACE_FIXED_LEN (1 + 1 + 1 + 1 + 2 + 4 + 4 + 4 + 4 + 8 + 4 * CRP_TRACE_BLOCK)
+
+#if (defined(MESSAGE_SIZE) && MESSAGE_SIZE != CRP_TRACE_BLOCK) || \
+    (defined(HASH_SIZE) && HASH_SIZE != CRP_TRACE_BLOCK)
+#error "Trace format records 32-byte messages and digests"
+#endif
+
+// Record roles
+#define CRP_TRACE_ALICE 'A'
+#define CRP_TRACE_BOB   'B'
+
+// Record status
+#define CRP_TRACE_OK           0
+#define CRP_TRACE_SIG_FAILED   1   // Bob rejected the signature
+#define CRP_TRACE_ACK_FAILED   2   // Alice rejected Bob's response
+#define CRP_TRACE_NO_RESPONSE  3   // Alice ran before Bob responded
+
+// Record mode
+#define CRP_TRACE_LEGACY   0   // Full shared key on every message
+#define CRP_TRACE_SESSION  1   // HKDF subkeys, see crp_session.h
+
+typedef struct {
+    unsigned char role;
+    unsigned char status;
+    unsigned char mode;
+    int counter;
+    int nonce;
+    int session_counter;   // Session mode only: counter/nonce the subkeys came from
+    int session_nonce;
+    uint64_t elapsed_ns;
+    unsigned char message[CRP_TRACE_BLOCK];
+    unsigned char ciphertext[CRP_TRACE_BLOCK];
+    unsigned char signature[CRP_TRACE_BLOCK];
+    unsigned char response[CRP_TRACE_BLOCK];
+    size_t key_len;
+    unsigned char *key;   // Owned by the record when read with crp_trace_read()
+} crp_trace_record;
+
+/*============================
+        Monotonic clock
+==============================*/
+static inline uint64_t crp_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*============================
+        Little-endian helpers
+==============================*/
+static inline void crp_put_le(unsigned char *out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static inline uint64_t crp_get_le(const unsigned char *in, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+/*============================
+        Append a record
+==============================*/
+// Does nothing unless CRP_TRACE is set. Trace failures are reported but never
+// abort the protocol run.
+static inline void crp_trace_append(const crp_trace_record *rec)
+{
+    const char *path = getenv(CRP_TRACE_ENV);
+    if (path == NULL || path[0] == '\0') {
+        return;
+    }
+    if (rec->key_len > 0xffff) {
+        printf("Trace: key too long to record, skipping\n");
+        return;
+    }
+
+    // Owner-only, since records carry the shared key
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (fd >= 0 && flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    FILE *file = fd >= 0 ? fdopen(fd, "ab") : NULL;
+    if (file == NULL) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        printf("Trace: error opening file: %s\n", path);
+        return;
+    }
+
+    // Under the lock, so only the first writer of a new trace adds the header
+    fseek(file, 0L, SEEK_END);
+    if (ftell(file) == 0) {
+        unsigned char header[12];
+        memcpy(header, CRP_TRACE_MAGIC, 8);
+        crp_put_le(header + 8, CRP_TRACE_VERSION, 4);
+        fwrite(header, 1, sizeof(header), file);
+    }
+
+    unsigned char fixed[CRP_TRACE_FIXED_LEN];
+    unsigned char *p = fixed;
+    *p++ = rec->role;
+    *p++ = rec->status;
+    *p++ = rec->mode;
+    *p++ = 0;
+    crp_put_le(p, rec->key_len, 2);                   p += 2;
+    crp_put_le(p, (uint32_t)rec->counter, 4);         p += 4;
+    crp_put_le(p, (uint32_t)rec->nonce, 4);           p += 4;
+    crp_put_le(p, (uint32_t)rec->session_counter, 4); p += 4;
+    crp_put_le(p, (uint32_t)rec->session_nonce, 4);   p += 4;
+    crp_put_le(p, rec->elapsed_ns, 8);                p += 8;
+    memcpy(p, rec->message, CRP_TRACE_BLOCK);         p += CRP_TRACE_BLOCK;
+    memcpy(p, rec->ciphertext, CRP_TRACE_BLOCK);      p += CRP_TRACE_BLOCK;
+    memcpy(p, rec->signature, CRP_TRACE_BLOCK);       p += CRP_TRACE_BLOCK;
+    memcpy(p, rec->response, CRP_TRACE_BLOCK);
+
+    if (fwrite(fixed, 1, sizeof(fixed), file) != sizeof(fixed) ||
+        fwrite(rec->key, 1, rec->key_len, file) != rec->key_len) {
+        printf("Trace: error writing file: %s\n", path);
+    }
+    fclose(file);   // Flushes, then closing the descriptor releases the lock
+}
+
+/*============================
+        Read trace header
+==============================*/
+// Returns 1 if the file starts with a header for this format, 0 otherwise
+static inline int crp_trace_read_header(FILE *file)
+{
+    unsigned char header[12];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, CRP_TRACE_MAGIC, 8) != 0) {
+        return 0;
+    }
+    return crp_get_le(header + 8, 4) == CRP_TRACE_VERSION;
+}
+
+/*============================
+        Read next record
+==============================*/
+// Returns 1 on success, 0 at end of file, -1 on a truncated record.
+// On success rec->key is malloc'ed and must be freed by the caller.
+static inline int crp_trace_read(FILE *file, crp_trace_record *rec)
+{
+    unsigned char fixed[CRP_TRACE_FIXED_LEN];
+    size_t got = fread(fixed, 1, sizeof(fixed), file);
+    if (got == 0) {
+        return 0;
+    }
+    if (got != sizeof(fixed)) {
+        return -1;
+    }
+
+    const unsigned char *p = fixed;
+    rec->role = *p++;
+    rec->status = *p++;
+    rec->mode = *p++;
+    p++;  // reserved
+    rec->key_len = (size_t)crp_get_le(p, 2);                  p += 2;
+    rec->counter = (int)(uint32_t)crp_get_le(p, 4);           p += 4;
+    rec->nonce = (int)(uint32_t)crp_get_le(p, 4);             p += 4;
+    rec->session_counter = (int)(uint32_t)crp_get_le(p, 4);   p += 4;
+    rec->session_nonce = (int)(uint32_t)crp_get_le(p, 4);     p += 4;
+    rec->elapsed_ns = crp_get_le(p, 8);                       p += 8;
+    memcpy(rec->message, p, CRP_TRACE_BLOCK);                 p += CRP_TRACE_BLOCK;
+    memcpy(rec->ciphertext, p, CRP_TRACE_BLOCK);              p += CRP_TRACE_BLOCK;
+    memcpy(rec->signature, p, CRP_TRACE_BLOCK);               p += CRP_TRACE_BLOCK;
+    memcpy(rec->response, p, CRP_TRACE_BLOCK);
+
+    rec->key = malloc(rec->key_len > 0 ? rec->key_len : 1);
+    if (fread(rec->key, 1, rec->key_len, file) != rec->key_len) {
+        free(rec->key);
+        rec->key = NULL;
+        return -1;
+    }
+    return 1;
+}
+
+#endif // CRP_TRACE_H
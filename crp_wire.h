@@ -0,0 +1,91 @@
+/**************************
+ *      Wire Format        *
+ **************************
+ *
+ * Fixed-size frames exchanged with bob_server over TCP, one reply per frame.
+ *
+ *   HELLO  (client -> server, 8 bytes):
+ *       'H', mode (u8), reserved (u16), peer_id (u32)
+ *   HELLO reply (4 bytes):
+ *       'H', status (u8), shard (u8), owner (u8)
+ *       ('owner' is the shard that owns the peer for WRONG_SHARD, otherwise
+ *       the same as 'shard')
+ *
+ *   MSG    (client -> server, 68 bytes):
+ *       'M', reserved (3 bytes), ciphertext[32], signature[32]
+ *   MSG reply (36 bytes):
+ *       'M', status (u8), shard (u8), reserved (u8), response[32]
+ *
+ * Integers are little-endian. A connection carries one peer: HELLO names the
+ * peer and mode, then every MSG is a challenge from that peer, processed with
+ * the counter/nonce state its shard keeps for it across connections. 'shard'
+ * is always the index of the worker that answered, so clients can see where
+ * SO_REUSEPORT placed a connection. Each peer is owned by one shard; a client whose HELLO lands on
+ * another shard gets WRONG_SHARD and reconnects to the owner's own port
+ * (server port + 1 + shard). A connection accepts one successful HELLO. HELLO
+ * is not authenticated: it holds the peer only until a MSG on the connection
+ * verifies, and a newer HELLO for the peer takes over an unverified holder
+ * (whose next MSG gets NO_HELLO). Once verified, the peer is busy until that
+ * connection closes; idle connections are closed by the server.
+ *
+ */
+
+#ifndef CRP_WIRE_H
+#define CRP_WIRE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define CRP_WIRE_HELLO 'H'
+#define CRP_WIRE_MSG   'M'
+
+#define CRP_WIRE_HELLO_LEN       8
+#define CRP_WIRE_HELLO_REPLY_LEN 4
+#define CRP_WIRE_MSG_LEN         (4 + 32 + 32)
+#define CRP_WIRE_MSG_REPLY_LEN   (4 + 32)
+
+// HELLO mode
+#define CRP_WIRE_LEGACY  0   // Full shared key on every message
+#define CRP_WIRE_SESSION 1   // HKDF subkeys derived at HELLO, see crp_session.h
+
+// Reply status
+#define CRP_WIRE_OK              0
+#define CRP_WIRE_SIG_FAILED      1   // Signature did not verify, state unchanged
+#define CRP_WIRE_UNKNOWN_PEER    2   // peer_id not in the keyring
+#define CRP_WIRE_NO_HELLO        3   // MSG before a successful HELLO, or after another took over
+#define CRP_WIRE_BAD_FRAME       4   // Unknown frame type or mode
+#define CRP_WIRE_SERVER_ERROR    5   // OpenSSL failed on the server, state unchanged
+#define CRP_WIRE_WRONG_SHARD     6   // Another shard owns the peer, reconnect to it
+#define CRP_WIRE_DUPLICATE_HELLO 7   // This connection already has a peer
+#define CRP_WIRE_PEER_BUSY       8   // Another connection for the peer has verified a MSG
+
+/*============================
+        u32 little-endian
+==============================*/
+static inline void crp_wire_put_u32(unsigned char *out, uint32_t value)
+{
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+    out[2] = (unsigned char)(value >> 16);
+    out[3] = (unsigned char)(value >> 24);
+}
+
+static inline uint32_t crp_wire_get_u32(const unsigned char *in)
+{
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+/*============================
+        Request frame length
+==============================*/
+// Length of the client frame that starts with 'type', 0 if unknown
+static inline size_t crp_wire_request_len(unsigned char type)
+{
+    switch (type) {
+        case CRP_WIRE_HELLO: return CRP_WIRE_HELLO_LEN;
+        case CRP_WIRE_MSG:   return CRP_WIRE_MSG_LEN;
+    }
+    return 0;
+}
+
+#endif // CRP_WIRE_H
@@ -0,0 +1,915 @@
+/**************************
+ *      Differential Test        *
+ **************************
+ *
+ * Generates randomized handshakes and runs every optimized path against a
+ * reference that computes exactly what the original alice.c/bob.c did
+ * (sprintf("%d") and malloc+memcpy concatenation, SHA256(), HMAC(EVP_sha256()),
+ * memcmp, sprintf/strtol hex conversion), reporting any divergence.
+ *
+ * Vectors mix key lengths around the HMAC block size (64) and the engine's
+ * stack/heap cutoff (CRP_STACK_KEY_MAX), counters and nonces next to
+ * decimal-digit boundaries (9/10, 99/100, ..., negatives, INT_MIN), and
+ * these cases:
+ *   ok          Bob has Alice's key, counter and nonce
+ *   nonce       Bob's nonce differs
+ *   counter     Bob's counter differs (signature verifies, response must not)
+ *   wrong-key   Bob's key differs in one byte or in length
+ *   sig-bit     one bit of the signature flipped
+ *   sig-hex     one character of Signature.txt's hex text replaced
+ *   ct-bit      one bit of the ciphertext flipped
+ *
+ * Paths checked against the reference, each from Alice's challenge through
+ * the hex files, Bob's verdict, message and response, to Alice's verdict:
+ *   kernels     crp_kernels.h dispatchers, 64-byte hex kernels, decimal packing
+ *   engine      crp_engine.h with the SHA-256/HMAC of crp_crypto.h as compiled
+ *               (build with -DCRP_SHA256_LOWLEVEL to check the opt-in variant)
+ *   crypto      the protocol on crp_crypto.h's helpers called directly:
+ *               crp_digest() on the cached SHA-256 handle, crp_hmac_sha256()
+ *   session     crp_session.h against HKDF/HMAC computed from scratch
+ *
+ * Each vector also runs the RequiredFunctionsHW1.c helpers on its key and
+ * message (reported as "hw1 funcs"): HMAC_SHA256 against HMAC(EVP_sha256()),
+ * Hash_Blake2s against EVP_Digest(EVP_blake2s256()), and PRNG against a
+ * ChaCha20 keystream from a fresh EVP_CIPHER_CTX, for outputs of 0 to ~1000
+ * bytes. RequiredFunctionsHW1.c is included rather than linked, so that it
+ * shares the handles crp_crypto_init() fetches before the threads start.
+ *
+ * bob_server's frame handling is not covered here; bench_shards checks every
+ * response the server sends, and its per-peer state, end to end.
+ *
+ * Vector i depends only on (seed, i), so a reported divergence reproduces
+ * with the same seed whatever the thread count.
+ *
+ * Usage: ./difftest [vectors] [threads] [seed]
+ *        (defaults: 1000000 vectors, one thread per available CPU, seed 1)
+ * Build: gcc -O2 difftest.c -lcrypto -lpthread -o difftest   (Linux only)
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sched.h>
+#include <pthread.h>
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/kdf.h>
+
+#define HASH_SIZE 32
+#define MESSAGE_SIZE 32
+
+#include "crp_engine.h"
+#include "crp_session.h"
+#include "crp_trace.h"   // crp_now_ns()
+
+// The course template's file helpers mix char and unsigned char buffers
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpointer-sign"
+#include "RequiredFunctionsHW1.c"
+#pragma GCC diagnostic pop
+
+#define DEFAULT_VECTORS 1000000L
+#define MAX_KEY 320
+#define MAX_REPORTED 10
+// PRNG output length is 3 * key_len, so keystreams span several chunks
+#define MAX_PRNG (3 * (MAX_KEY + 1))
+// Highest counter/nonce generated: session vectors use value+1 and value+2
+#define MAX_VALUE (INT_MAX - 2)
+
+enum { CASE_OK, CASE_NONCE, CASE_COUNTER, CASE_WRONG_KEY, CASE_SIG_BIT, CASE_SIG_HEX, CASE_CT_BIT, CASE_COUNT };
+static const char *case_names[CASE_COUNT] = {
+    "ok", "nonce", "counter", "wrong-key", "sig-bit", "sig-hex", "ct-bit"
+};
+
+typedef struct {
+    int kind;
+    unsigned char key[MAX_KEY + 1];
+    size_t key_len;
+    unsigned char bob_key[MAX_KEY + 1];
+    size_t bob_key_len;
+    int counter;
+    int nonce;
+    int bob_counter;
+    int bob_nonce;
+    unsigned char message[MESSAGE_SIZE];
+    int flip_bit;              // ct-bit / sig-bit: bit index 0-255
+    int hex_pos;               // sig-hex: character index 0-63
+    char hex_char;             // sig-hex: replacement character
+} vector;
+
+// Everything a handshake makes observable, in order
+typedef struct {
+    unsigned char ciphertext[MESSAGE_SIZE];
+    unsigned char signature[HASH_SIZE];
+    char ciphertext_hex[2 * MESSAGE_SIZE + 1];
+    char signature_hex[2 * HASH_SIZE + 1];
+    unsigned char bob_ciphertext[MESSAGE_SIZE];
+    unsigned char bob_signature[HASH_SIZE];
+    int bob_accepted;
+    unsigned char bob_message[MESSAGE_SIZE];
+    unsigned char response[HASH_SIZE];
+    int alice_accepted;
+} outcome;
+
+typedef struct worker worker;
+
+// One implementation of the protocol, driven by run_path()
+typedef struct {
+    const char *name;
+    size_t hex_width;          // Ciphertext and signature hex-encoded separately (32) or as one block (64)
+    void (*challenge)(worker *w, const vector *v, unsigned char ciphertext[], unsigned char signature[]);
+    int (*process)(worker *w, const vector *v, const unsigned char ciphertext[],
+                   const unsigned char signature[], unsigned char message[], unsigned char response[]);
+    int (*verify)(worker *w, const vector *v, const unsigned char message[], const unsigned char response[]);
+    void (*to_hex)(char *out, const unsigned char *in, size_t width);
+    void (*from_hex)(unsigned char *out, const char *hex, size_t width);
+} path;
+
+struct worker {
+    long begin;
+    long end;
+    uint64_t seed;
+    crp_session alice_session; // session path, rebuilt per vector
+    crp_session bob_session;
+    long cases[CASE_COUNT];
+    long bob_accepts[CASE_COUNT];
+    long alice_acks[CASE_COUNT];
+    long *divergences;         // per path
+    long hw1_divergences;      // RequiredFunctionsHW1.c helpers
+};
+
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+static long reported;
+
+/*============================
+        Random numbers
+==============================*/
+static uint64_t splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static int random_below(uint64_t *state, int n)
+{
+    return (int)(splitmix64(state) % (uint64_t)n);
+}
+
+// Counters/nonces: mostly next to a power of ten, plus the extremes and noise
+static int random_value(uint64_t *state)
+{
+    int pick = random_below(state, 10);
+    if (pick < 6) {
+        int power = 1;
+        for (int digits = 1 + random_below(state, 9); digits > 0; digits--) {
+            power *= 10;
+        }
+        int value = power + random_below(state, 5) - 2;
+        return random_below(state, 4) == 0 ? -value : value;
+    }
+    if (pick == 6) {
+        return random_below(state, 41) - 20;
+    }
+    if (pick == 7) {
+        return random_below(state, 2) ? INT_MIN + random_below(state, 4) : MAX_VALUE - random_below(state, 4);
+    }
+    int value = (int)(uint32_t)splitmix64(state);
+    return value > MAX_VALUE ? MAX_VALUE : value;
+}
+
+// A different value 1-3 away, staying within [INT_MIN, MAX_VALUE]
+static int nearby_value(uint64_t *state, int value)
+{
+    int delta = 1 + random_below(state, 3);
+    return value > MAX_VALUE - delta ? value - delta : value + delta;
+}
+
+static size_t random_key_len(uint64_t *state)
+{
+    switch (random_below(state, 8)) {
+        case 0: return 62 + random_below(state, 5);                            // HMAC block size
+        case 1: return CRP_STACK_KEY_MAX - 2 + random_below(state, 5);         // stack/heap cutoff
+        case 2: return random_below(state, 2);                                 // empty or one byte
+        case 3: case 4: return 1 + random_below(state, MAX_KEY);
+        default: return 1 + random_below(state, 40);                           // typical key file
+    }
+}
+
+static void random_key(uint64_t *state, unsigned char *key, size_t len)
+{
+    // Half printable like SharedKey.txt, half arbitrary bytes
+    int printable = random_below(state, 2);
+    for (size_t i = 0; i < len; i++) {
+        uint64_t r = splitmix64(state);
+        key[i] = printable ? (unsigned char)(' ' + r % 95) : (unsigned char)r;
+    }
+}
+
+/*============================
+        Vector generation
+==============================*/
+static void make_vector(uint64_t seed, long index, vector *v)
+{
+    uint64_t state = seed ^ ((uint64_t)index * 0xD1B54A32D192ED03ull);
+    memset(v, 0, sizeof(*v));
+
+    v->kind = random_below(&state, CASE_COUNT);
+    v->key_len = random_key_len(&state);
+    random_key(&state, v->key, v->key_len);
+    v->counter = random_value(&state);
+    v->nonce = random_value(&state);
+    for (int i = 0; i < MESSAGE_SIZE; i++) {
+        v->message[i] = (unsigned char)splitmix64(&state);
+    }
+
+    memcpy(v->bob_key, v->key, v->key_len);
+    v->bob_key_len = v->key_len;
+    v->bob_counter = v->counter;
+    v->bob_nonce = v->nonce;
+
+    switch (v->kind) {
+        case CASE_NONCE:
+            v->bob_nonce = nearby_value(&state, v->nonce);
+            break;
+        case CASE_COUNTER:
+            v->bob_counter = nearby_value(&state, v->counter);
+            break;
+        case CASE_WRONG_KEY:
+            if (v->key_len > 0 && random_below(&state, 3) == 0) {
+                v->bob_key_len--;
+            } else if (v->key_len > 0 && random_below(&state, 2) == 0) {
+                v->bob_key[random_below(&state, (int)v->key_len)] ^= 1 + random_below(&state, 255);
+            } else {
+                v->bob_key[v->bob_key_len++] = (unsigned char)splitmix64(&state);
+            }
+            break;
+        case CASE_SIG_BIT:
+        case CASE_CT_BIT:
+            v->flip_bit = random_below(&state, 8 * HASH_SIZE);
+            break;
+        case CASE_SIG_HEX: {
+            // Non-hex characters, ones strtol() skips or reads as a sign,
+            // uppercase digits (same value) and NUL
+            static const char replacements[] = " \t\n+-xXgGz:/@`AF0";
+            v->hex_pos = random_below(&state, 2 * HASH_SIZE);
+            v->hex_char = replacements[random_below(&state, sizeof(replacements))];
+            if (random_below(&state, 8) == 0) {
+                v->hex_char = (char)(0x80 + random_below(&state, 128));
+            }
+            break;
+        }
+    }
+}
+
+/*============================
+        Reference: original alice.c/bob.c
+==============================*/
+static void ref_key_counter_hash(const unsigned char *key, size_t key_len, int counter,
+                                 unsigned char pad[HASH_SIZE])
+{
+    char counter_str[20];
+    sprintf(counter_str, "%d", counter);
+    unsigned char* key_counter = malloc(key_len + strlen(counter_str));
+    memcpy(key_counter, key, key_len);
+    memcpy(key_counter + key_len, counter_str, strlen(counter_str));
+    SHA256(key_counter, key_len + strlen(counter_str), pad);
+    free(key_counter);
+}
+
+static void ref_sign(const unsigned char *key, size_t key_len, int nonce,
+                     const unsigned char ciphertext[MESSAGE_SIZE], unsigned char signature[HASH_SIZE])
+{
+    char nonce_str[20];
+    sprintf(nonce_str, "%d", nonce);
+    unsigned char* cipher_nonce = malloc(MESSAGE_SIZE + strlen(nonce_str));
+    memcpy(cipher_nonce, ciphertext, MESSAGE_SIZE);
+    memcpy(cipher_nonce + MESSAGE_SIZE, nonce_str, strlen(nonce_str));
+    unsigned int sig_len;
+    HMAC(EVP_sha256(), key, (int)key_len, cipher_nonce, MESSAGE_SIZE + strlen(nonce_str), signature, &sig_len);
+    free(cipher_nonce);
+}
+
+static void ref_response(const unsigned char message[MESSAGE_SIZE], int counter, int nonce,
+                         unsigned char response[HASH_SIZE])
+{
+    char counter_str[20];
+    char nonce_str[20];
+    sprintf(counter_str, "%d", counter + 1);
+    sprintf(nonce_str, "%d", nonce + 1);
+    size_t len = MESSAGE_SIZE + strlen(counter_str) + strlen(nonce_str);
+    unsigned char* msg_ctr_nonce = malloc(len);
+    memcpy(msg_ctr_nonce, message, MESSAGE_SIZE);
+    memcpy(msg_ctr_nonce + MESSAGE_SIZE, counter_str, strlen(counter_str));
+    memcpy(msg_ctr_nonce + MESSAGE_SIZE + strlen(counter_str), nonce_str, strlen(nonce_str));
+    SHA256(msg_ctr_nonce, len, response);
+    free(msg_ctr_nonce);
+}
+
+static void xor_arrays(const unsigned char* a, const unsigned char* b, unsigned char* result, int len)
+{
+    for (int i = 0; i < len; i++) {
+        result[i] = a[i] ^ b[i];
+    }
+}
+
+static void ref_challenge(worker *w, const vector *v, unsigned char ciphertext[], unsigned char signature[])
+{
+    (void)w;
+    unsigned char pad[HASH_SIZE];
+    ref_key_counter_hash(v->key, v->key_len, v->counter, pad);
+    xor_arrays(v->message, pad, ciphertext, MESSAGE_SIZE);
+    ref_sign(v->key, v->key_len, v->nonce, ciphertext, signature);
+}
+
+static int ref_process(worker *w, const vector *v, const unsigned char ciphertext[],
+                       const unsigned char signature[], unsigned char message[], unsigned char response[])
+{
+    (void)w;
+    unsigned char expected_signature[HASH_SIZE];
+    ref_sign(v->bob_key, v->bob_key_len, v->bob_nonce, ciphertext, expected_signature);
+    if (memcmp(signature, expected_signature, HASH_SIZE) != 0) {
+        return 0;
+    }
+    unsigned char pad[HASH_SIZE];
+    ref_key_counter_hash(v->bob_key, v->bob_key_len, v->bob_counter, pad);
+    xor_arrays(ciphertext, pad, message, MESSAGE_SIZE);
+    ref_response(message, v->bob_counter, v->bob_nonce, response);
+    return 1;
+}
+
+static int ref_verify(worker *w, const vector *v, const unsigned char message[], const unsigned char response[])
+{
+    (void)w;
+    (void)message;
+    unsigned char expected_response[HASH_SIZE];
+    ref_response(v->message, v->counter, v->nonce, expected_response);
+    return memcmp(response, expected_response, HASH_SIZE) == 0;
+}
+
+static void ref_to_hex(char *out, const unsigned char *in, size_t width)
+{
+    for (size_t i = 0; i < width; i++) {
+        sprintf(&out[2*i], "%02x", in[i]);
+    }
+}
+
+static void ref_from_hex(unsigned char *out, const char *hex, size_t width)
+{
+    for (size_t i = 0; i < width; i++) {
+        char tmp[3];
+        tmp[0] = hex[2*i];
+        tmp[1] = hex[2*i+1];
+        tmp[2] = '\0';
+        out[i] = (unsigned char)strtol(tmp, NULL, 16);
+    }
+}
+
+/*============================
+        Path: kernels
+==============================*/
+// Original hashing, with concatenation, XOR, comparison and hex done by crp_kernels.h
+static void kernel_key_counter_hash(const unsigned char *key, size_t key_len, int counter,
+                                    unsigned char pad[HASH_SIZE])
+{
+    unsigned char key_counter[MAX_KEY + 1 + CRP_MAX_DEC_LEN + 1];
+    memcpy(key_counter, key, key_len);
+    size_t counter_len = crp_format_dec(counter, (char*)key_counter + key_len);
+    SHA256(key_counter, key_len + counter_len, pad);
+}
+
+static void kernel_sign(const unsigned char *key, size_t key_len, int nonce,
+                        const unsigned char ciphertext[MESSAGE_SIZE], unsigned char signature[HASH_SIZE])
+{
+    unsigned char cipher_nonce[CRP_BLOCK_DEC_MAX(MESSAGE_SIZE)];
+    size_t len = crp_pack_dec_32(cipher_nonce, ciphertext, nonce);
+    unsigned int sig_len;
+    HMAC(EVP_sha256(), key, (int)key_len, cipher_nonce, len, signature, &sig_len);
+}
+
+static void kernel_response(const unsigned char message[MESSAGE_SIZE], int counter, int nonce,
+                            unsigned char response[HASH_SIZE])
+{
+    unsigned char msg_ctr_nonce[CRP_BLOCK_DEC2_MAX(MESSAGE_SIZE)];
+    size_t len = crp_pack_dec2_32(msg_ctr_nonce, message, counter + 1, nonce + 1);
+    SHA256(msg_ctr_nonce, len, response);
+}
+
+static void kernel_challenge(worker *w, const vector *v, unsigned char ciphertext[], unsigned char signature[])
+{
+    (void)w;
+    unsigned char pad[HASH_SIZE];
+    kernel_key_counter_hash(v->key, v->key_len, v->counter, pad);
+    crp_xor(ciphertext, v->message, pad, MESSAGE_SIZE);
+    kernel_sign(v->key, v->key_len, v->nonce, ciphertext, signature);
+}
+
+static int kernel_process(worker *w, const vector *v, const unsigned char ciphertext[],
+                          const unsigned char signature[], unsigned char message[], unsigned char response[])
+{
+    (void)w;
+    unsigned char expected_signature[HASH_SIZE];
+    kernel_sign(v->bob_key, v->bob_key_len, v->bob_nonce, ciphertext, expected_signature);
+    if (!crp_equal(signature, expected_signature, HASH_SIZE)) {
+        return 0;
+    }
+    unsigned char pad[HASH_SIZE];
+    kernel_key_counter_hash(v->bob_key, v->bob_key_len, v->bob_counter, pad);
+    crp_xor(message, ciphertext, pad, MESSAGE_SIZE);
+    kernel_response(message, v->bob_counter, v->bob_nonce, response);
+    return 1;
+}
+
+static int kernel_verify(worker *w, const vector *v, const unsigned char message[], const unsigned char response[])
+{
+    (void)w;
+    (void)message;
+    unsigned char expected_response[HASH_SIZE];
+    kernel_response(v->message, v->counter, v->nonce, expected_response);
+    return crp_equal(response, expected_response, HASH_SIZE);
+}
+
+/*============================
+        Path: engine
+==============================*/
+static void engine_challenge(worker *w, const vector *v, unsigned char ciphertext[], unsigned char signature[])
+{
+    (void)w;
+    if (!crp_alice_challenge(v->key, v->key_len, v->counter, v->nonce, v->message, ciphertext, signature)) {
+        memset(ciphertext, 0, MESSAGE_SIZE);   // reported as a ciphertext divergence
+        memset(signature, 0, HASH_SIZE);
+    }
+}
+
+static int engine_process(worker *w, const vector *v, const unsigned char ciphertext[],
+                          const unsigned char signature[], unsigned char message[], unsigned char response[])
+{
+    (void)w;
+    return crp_bob_process(v->bob_key, v->bob_key_len, v->bob_counter, v->bob_nonce,
+                           ciphertext, signature, message, response);
+}
+
+static int engine_verify(worker *w, const vector *v, const unsigned char message[], const unsigned char response[])
+{
+    (void)w;
+    (void)message;
+    return crp_alice_verify(v->message, v->counter, v->nonce, response);
+}
+
+/*============================
+        Path: crypto
+==============================*/
+// The protocol on crp_crypto.h's helpers: crp_digest() with the cached
+// SHA-256 handle and crp_hmac_sha256(). A failed call leaves zeros, which
+// shows up as a divergence.
+static void crypto_key_counter_hash(const unsigned char *key, size_t key_len, int counter,
+                                    unsigned char pad[HASH_SIZE])
+{
+    unsigned char key_counter[MAX_KEY + 1 + CRP_MAX_DEC_LEN + 1];
+    memcpy(key_counter, key, key_len);
+    size_t counter_len = crp_format_dec(counter, (char*)key_counter + key_len);
+    if (!crp_digest(crp_md_sha256(), key_counter, key_len + counter_len, pad)) {
+        memset(pad, 0, HASH_SIZE);
+    }
+}
+
+static void crypto_sign(const unsigned char *key, size_t key_len, int nonce,
+                        const unsigned char ciphertext[MESSAGE_SIZE], unsigned char signature[HASH_SIZE])
+{
+    unsigned char cipher_nonce[CRP_BLOCK_DEC_MAX(MESSAGE_SIZE)];
+    size_t len = crp_pack_dec_32(cipher_nonce, ciphertext, nonce);
+    if (!crp_hmac_sha256(key, key_len, cipher_nonce, len, signature)) {
+        memset(signature, 0, HASH_SIZE);
+    }
+}
+
+static void crypto_response(const unsigned char message[MESSAGE_SIZE], int counter, int nonce,
+                            unsigned char response[HASH_SIZE])
+{
+    unsigned char msg_ctr_nonce[CRP_BLOCK_DEC2_MAX(MESSAGE_SIZE)];
+    size_t len = crp_pack_dec2_32(msg_ctr_nonce, message, counter + 1, nonce + 1);
+    if (!crp_digest(crp_md_sha256(), msg_ctr_nonce, len, response)) {
+        memset(response, 0, HASH_SIZE);
+    }
+}
+
+static void crypto_challenge(worker *w, const vector *v, unsigned char ciphertext[], unsigned char signature[])
+{
+    (void)w;
+    unsigned char pad[HASH_SIZE];
+    crypto_key_counter_hash(v->key, v->key_len, v->counter, pad);
+    crp_xor_32(ciphertext, v->message, pad);
+    crypto_sign(v->key, v->key_len, v->nonce, ciphertext, signature);
+}
+
+static int crypto_process(worker *w, const vector *v, const unsigned char ciphertext[],
+                          const unsigned char signature[], unsigned char message[], unsigned char response[])
+{
+    (void)w;
+    unsigned char expected_signature[HASH_SIZE];
+    crypto_sign(v->bob_key, v->bob_key_len, v->bob_nonce, ciphertext, expected_signature);
+    if (!crp_equal_32(signature, expected_signature)) {
+        return 0;
+    }
+    unsigned char pad[HASH_SIZE];
+    crypto_key_counter_hash(v->bob_key, v->bob_key_len, v->bob_counter, pad);
+    crp_xor_32(message, ciphertext, pad);
+    crypto_response(message, v->bob_counter, v->bob_nonce, response);
+    return 1;
+}
+
+static int crypto_verify(worker *w, const vector *v, const unsigned char message[], const unsigned char response[])
+{
+    (void)w;
+    (void)message;
+    unsigned char expected_response[HASH_SIZE];
+    crypto_response(v->message, v->counter, v->nonce, expected_response);
+    return crp_equal_32(response, expected_response);
+}
+
+/*============================
+        Path: session
+==============================*/
+// Both sides start the session at Alice's counter/nonce; each side first
+// handles a throw-away message so the checked one runs on a re-initialized
+// MAC context, as in a long session.
+static void session_challenge(worker *w, const vector *v, unsigned char ciphertext[], unsigned char signature[])
+{
+    if (!crp_session_init(&w->alice_session, v->key, v->key_len, v->counter, v->nonce)) {
+        memset(ciphertext, 0, MESSAGE_SIZE);   // reported as a ciphertext divergence
+        memset(signature, 0, HASH_SIZE);
+        return;
+    }
+    unsigned char scratch_ct[MESSAGE_SIZE];
+    unsigned char scratch_sig[HASH_SIZE];
+    if (!crp_session_alice_challenge(&w->alice_session, v->counter + 1, v->nonce + 1, v->message, scratch_ct, scratch_sig) ||
+        !crp_session_alice_challenge(&w->alice_session, v->counter, v->nonce, v->message, ciphertext, signature)) {
+        memset(ciphertext, 0, MESSAGE_SIZE);   // reported as a ciphertext divergence
+        memset(signature, 0, HASH_SIZE);
+    }
+}
+
+static int session_process(worker *w, const vector *v, const unsigned char ciphertext[],
+                           const unsigned char signature[], unsigned char message[], unsigned char response[])
+{
+    if (!crp_session_init(&w->bob_session, v->bob_key, v->bob_key_len, v->counter, v->nonce)) {
+        return 0;
+    }
+    unsigned char scratch_msg[MESSAGE_SIZE];
+    unsigned char scratch_resp[HASH_SIZE];
+    if (crp_session_bob_process(&w->bob_session, v->bob_counter + 1, v->bob_nonce + 1,
+                                ciphertext, signature, scratch_msg, scratch_resp) == CRP_SESSION_ERROR) {
+        return CRP_SESSION_ERROR;   // never equal to the reference verdict
+    }
+    return crp_session_bob_process(&w->bob_session, v->bob_counter, v->bob_nonce,
+                                   ciphertext, signature, message, response);
+}
+
+static int session_verify(worker *w, const vector *v, const unsigned char message[], const unsigned char response[])
+{
+    crp_session_free(&w->alice_session);
+    crp_session_free(&w->bob_session);
+    return engine_verify(w, v, message, response);
+}
+
+// Reference for session mode: HKDF with a fresh EVP_KDF, SHA256() and HMAC()
+static void ref_session_keys(const unsigned char *key, size_t key_len, int counter, int nonce,
+                             unsigned char enc_key[CRP_SUBKEY_SIZE], unsigned char mac_key[CRP_SUBKEY_SIZE])
+{
+    char salt[32];
+    sprintf(salt, "%d:%d", counter, nonce);
+    unsigned char subkeys[2 * CRP_SUBKEY_SIZE];
+    EVP_KDF *kdf = EVP_KDF_fetch(NULL, "HKDF", NULL);
+    EVP_KDF_CTX *kdf_ctx = EVP_KDF_CTX_new(kdf);
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, "SHA256", 0),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY, (void*)key, key_len),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT, salt, strlen(salt)),
+        OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_INFO, CRP_SESSION_INFO, strlen(CRP_SESSION_INFO)),
+        OSSL_PARAM_construct_end()
+    };
+    EVP_KDF_derive(kdf_ctx, subkeys, sizeof(subkeys), params);
+    EVP_KDF_CTX_free(kdf_ctx);
+    EVP_KDF_free(kdf);
+    memcpy(enc_key, subkeys, CRP_SUBKEY_SIZE);
+    memcpy(mac_key, subkeys + CRP_SUBKEY_SIZE, CRP_SUBKEY_SIZE);
+}
+
+static void ref_session_challenge(worker *w, const vector *v, unsigned char ciphertext[], unsigned char signature[])
+{
+    (void)w;
+    unsigned char enc_key[CRP_SUBKEY_SIZE], mac_key[CRP_SUBKEY_SIZE], pad[HASH_SIZE];
+    ref_session_keys(v->key, v->key_len, v->counter, v->nonce, enc_key, mac_key);
+    ref_key_counter_hash(enc_key, CRP_SUBKEY_SIZE, v->counter, pad);
+    xor_arrays(v->message, pad, ciphertext, MESSAGE_SIZE);
+    ref_sign(mac_key, CRP_SUBKEY_SIZE, v->nonce, ciphertext, signature);
+}
+
+static int ref_session_process(worker *w, const vector *v, const unsigned char ciphertext[],
+                               const unsigned char signature[], unsigned char message[], unsigned char response[])
+{
+    (void)w;
+    unsigned char enc_key[CRP_SUBKEY_SIZE], mac_key[CRP_SUBKEY_SIZE], expected_signature[HASH_SIZE];
+    ref_session_keys(v->bob_key, v->bob_key_len, v->counter, v->nonce, enc_key, mac_key);
+    ref_sign(mac_key, CRP_SUBKEY_SIZE, v->bob_nonce, ciphertext, expected_signature);
+    if (memcmp(signature, expected_signature, HASH_SIZE) != 0) {
+        return 0;
+    }
+    unsigned char pad[HASH_SIZE];
+    ref_key_counter_hash(enc_key, CRP_SUBKEY_SIZE, v->bob_counter, pad);
+    xor_arrays(ciphertext, pad, message, MESSAGE_SIZE);
+    ref_response(message, v->bob_counter, v->bob_nonce, response);
+    return 1;
+}
+
+/*============================
+        Paths
+==============================*/
+static const path reference = {
+    "reference", MESSAGE_SIZE, ref_challenge, ref_process, ref_verify, ref_to_hex, ref_from_hex
+};
+static const path session_reference = {
+    "session reference", MESSAGE_SIZE, ref_session_challenge, ref_session_process, ref_verify, ref_to_hex, ref_from_hex
+};
+
+#define PATH_COUNT 4
+static const path paths[PATH_COUNT] = {
+    { "kernels", 2 * MESSAGE_SIZE, kernel_challenge, kernel_process, kernel_verify, crp_to_hex, crp_from_hex },
+    { "engine", MESSAGE_SIZE, engine_challenge, engine_process, engine_verify, crp_to_hex, crp_from_hex },
+    { "crypto", MESSAGE_SIZE, crypto_challenge, crypto_process, crypto_verify, crp_to_hex, crp_from_hex },
+    { "session", MESSAGE_SIZE, session_challenge, session_process, session_verify, crp_to_hex, crp_from_hex },
+};
+#define SESSION_PATH 3
+
+// Row name of the RequiredFunctionsHW1.c checks, run besides the paths
+#define HW1_CHECK_NAME "hw1 funcs"
+
+/*============================
+        Run one handshake
+==============================*/
+static void run_path(const path *p, worker *w, const vector *v, outcome *o)
+{
+    memset(o, 0, sizeof(*o));
+
+    // Alice: challenge, with the corruption applied on the way to Bob
+    p->challenge(w, v, o->ciphertext, o->signature);
+    unsigned char ciphertext[MESSAGE_SIZE];
+    unsigned char signature[HASH_SIZE];
+    memcpy(ciphertext, o->ciphertext, MESSAGE_SIZE);
+    memcpy(signature, o->signature, HASH_SIZE);
+    if (v->kind == CASE_CT_BIT) ciphertext[v->flip_bit / 8] ^= 1 << (v->flip_bit % 8);
+    if (v->kind == CASE_SIG_BIT) signature[v->flip_bit / 8] ^= 1 << (v->flip_bit % 8);
+
+    // Ciphertext.txt / Signature.txt
+    char hex[2 * (MESSAGE_SIZE + HASH_SIZE) + 1];
+    unsigned char block[MESSAGE_SIZE + HASH_SIZE];
+    if (p->hex_width == MESSAGE_SIZE + HASH_SIZE) {
+        memcpy(block, ciphertext, MESSAGE_SIZE);
+        memcpy(block + MESSAGE_SIZE, signature, HASH_SIZE);
+        p->to_hex(hex, block, MESSAGE_SIZE + HASH_SIZE);
+    } else {
+        p->to_hex(hex, ciphertext, MESSAGE_SIZE);
+        p->to_hex(hex + 2 * MESSAGE_SIZE, signature, HASH_SIZE);
+    }
+    if (v->kind == CASE_SIG_HEX) hex[2 * MESSAGE_SIZE + v->hex_pos] = v->hex_char;
+    memcpy(o->ciphertext_hex, hex, 2 * MESSAGE_SIZE);
+    memcpy(o->signature_hex, hex + 2 * MESSAGE_SIZE, 2 * HASH_SIZE);
+
+    // Bob: parse, verify, decrypt, respond
+    if (p->hex_width == MESSAGE_SIZE + HASH_SIZE) {
+        p->from_hex(block, hex, MESSAGE_SIZE + HASH_SIZE);
+        memcpy(o->bob_ciphertext, block, MESSAGE_SIZE);
+        memcpy(o->bob_signature, block + MESSAGE_SIZE, HASH_SIZE);
+    } else {
+        p->from_hex(o->bob_ciphertext, hex, MESSAGE_SIZE);
+        p->from_hex(o->bob_signature, hex + 2 * MESSAGE_SIZE, HASH_SIZE);
+    }
+    o->bob_accepted = p->process(w, v, o->bob_ciphertext, o->bob_signature, o->bob_message, o->response);
+
+    // Alice: check the response (only sent if Bob accepted)
+    o->alice_accepted = p->verify(w, v, o->bob_message, o->response);
+    if (!o->bob_accepted) {
+        memset(o->bob_message, 0, MESSAGE_SIZE);
+        memset(o->response, 0, HASH_SIZE);
+        o->alice_accepted = 0;
+    }
+}
+
+// Name of the first field where two outcomes differ, NULL if identical
+static const char* outcome_diff(const outcome *a, const outcome *b)
+{
+    if (memcmp(a->ciphertext, b->ciphertext, MESSAGE_SIZE) != 0) return "ciphertext";
+    if (memcmp(a->signature, b->signature, HASH_SIZE) != 0) return "signature";
+    if (memcmp(a->ciphertext_hex, b->ciphertext_hex, sizeof(a->ciphertext_hex)) != 0) return "Ciphertext.txt";
+    if (memcmp(a->signature_hex, b->signature_hex, sizeof(a->signature_hex)) != 0) return "Signature.txt";
+    if (memcmp(a->bob_ciphertext, b->bob_ciphertext, MESSAGE_SIZE) != 0) return "Bob's parsed ciphertext";
+    if (memcmp(a->bob_signature, b->bob_signature, HASH_SIZE) != 0) return "Bob's parsed signature";
+    if (a->bob_accepted != b->bob_accepted) return "Bob's verdict";
+    if (memcmp(a->bob_message, b->bob_message, MESSAGE_SIZE) != 0) return "decrypted message";
+    if (memcmp(a->response, b->response, HASH_SIZE) != 0) return "response";
+    if (a->alice_accepted != b->alice_accepted) return "Alice's verdict";
+    return NULL;
+}
+
+static void report_divergence(const char *name, const vector *v, long index, const char *field)
+{
+    pthread_mutex_lock(&report_lock);
+    if (reported < MAX_REPORTED) {
+        printf("Difftest: %s diverges at vector %ld (%s, key_len %zu, counter %d/%d, nonce %d/%d): %s\n",
+               name, index, case_names[v->kind], v->key_len,
+               v->counter, v->bob_counter, v->nonce, v->bob_nonce, field);
+        if (v->kind == CASE_SIG_HEX) {
+            printf("          (signature hex character %d replaced with 0x%02x)\n",
+                   v->hex_pos, (unsigned char)v->hex_char);
+        }
+    }
+    reported++;
+    pthread_mutex_unlock(&report_lock);
+}
+
+/*============================
+        RequiredFunctionsHW1.c helpers
+==============================*/
+// Name of the first helper that differs from OpenSSL's one-shot API, NULL if none
+static const char* check_hw1_functions(const vector *v)
+{
+    // HMAC_SHA256: Alice's key over Bob's key bytes, so both lengths vary
+    unsigned char mac[HASH_SIZE], expected_mac[HASH_SIZE];
+    unsigned int mac_len = 0, expected_mac_len;
+    HMAC(EVP_sha256(), v->key, (int)v->key_len, v->bob_key, v->bob_key_len, expected_mac, &expected_mac_len);
+    if (HMAC_SHA256(v->key, (int)v->key_len, v->bob_key, v->bob_key_len, mac, &mac_len) != mac ||
+        mac_len != expected_mac_len || memcmp(mac, expected_mac, HASH_SIZE) != 0) {
+        return "HMAC_SHA256";
+    }
+
+    unsigned char expected_hash[32];
+    EVP_Digest(v->key, v->key_len, expected_hash, NULL, EVP_blake2s256(), NULL);
+    unsigned char *hash = Hash_Blake2s((unsigned char*)v->key, v->key_len);
+    int hash_ok = hash != NULL && memcmp(hash, expected_hash, sizeof(expected_hash)) == 0;
+    free(hash);
+    if (!hash_ok) {
+        return "Hash_Blake2s";
+    }
+
+    // PRNG: ChaCha20 keystream for a 32-byte seed, zero IV
+    static const unsigned char zeros[MAX_PRNG];
+    unsigned char expected_stream[MAX_PRNG];
+    size_t stream_len = 3 * v->key_len;
+    int out_len = 0;
+    unsigned char iv[16] = {0};
+    EVP_CIPHER_CTX *cipher_ctx = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(cipher_ctx, EVP_chacha20(), NULL, v->message, iv);
+    EVP_EncryptUpdate(cipher_ctx, expected_stream, &out_len, zeros, (int)stream_len);
+    EVP_CIPHER_CTX_free(cipher_ctx);
+    unsigned char *stream = PRNG((unsigned char*)v->message, MESSAGE_SIZE, stream_len);
+    int stream_ok = stream != NULL && memcmp(stream, expected_stream, stream_len) == 0;
+    free(stream);
+    if (!stream_ok) {
+        return "PRNG";
+    }
+    return NULL;
+}
+
+/*============================
+        Exhaustive hex pair check
+==============================*/
+// Every two-character string through crp_hex_pair() against strtol()
+static long check_hex_pairs(void)
+{
+    long mismatches = 0;
+    for (int hi = 0; hi < 256; hi++) {
+        for (int lo = 0; lo < 256; lo++) {
+            char tmp[3] = { (char)hi, (char)lo, '\0' };
+            unsigned char expected = (unsigned char)strtol(tmp, NULL, 16);
+            unsigned char got = crp_hex_pair(tmp[0], tmp[1]);
+            if (got != expected) {
+                if (mismatches < MAX_REPORTED) {
+                    printf("Difftest: kernels parse hex pair %02x %02x as %02x, strtol as %02x\n",
+                           hi, lo, got, expected);
+                }
+                mismatches++;
+            }
+        }
+    }
+    return mismatches;
+}
+
+/*============================
+        Worker thread
+==============================*/
+static void* worker_main(void *arg)
+{
+    worker *w = arg;
+    vector v;
+    outcome expected, expected_session, got;
+
+    for (long i = w->begin; i < w->end; i++) {
+        make_vector(w->seed, i, &v);
+        run_path(&reference, w, &v, &expected);
+        run_path(&session_reference, w, &v, &expected_session);
+        w->cases[v.kind]++;
+        w->bob_accepts[v.kind] += expected.bob_accepted;
+        w->alice_acks[v.kind] += expected.alice_accepted;
+
+        for (int p = 0; p < PATH_COUNT; p++) {
+            run_path(&paths[p], w, &v, &got);
+            const char *field = outcome_diff(p == SESSION_PATH ? &expected_session : &expected, &got);
+            if (field != NULL) {
+                w->divergences[p]++;
+                report_divergence(paths[p].name, &v, i, field);
+            }
+        }
+
+        const char *function = check_hw1_functions(&v);
+        if (function != NULL) {
+            w->hw1_divergences++;
+            report_divergence(HW1_CHECK_NAME, &v, i, function);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    long vectors = argc > 1 ? atol(argv[1]) : DEFAULT_VECTORS;
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    int threads = argc > 2 ? atoi(argv[2]) : CPU_COUNT(&allowed);
+    uint64_t seed = argc > 3 ? strtoull(argv[3], NULL, 0) : 1;
+    if (argc > 4 || vectors < 1 || threads < 1 || threads > 1024) {
+        printf("Usage: %s [vectors] [threads 1-1024] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    // Every thread shares these handles, so fetch them before starting any
+    if (!crp_crypto_init(CRP_ALG_SHA256 | CRP_ALG_HMAC | CRP_ALG_HKDF |
+                         CRP_ALG_BLAKE2S | CRP_ALG_CHACHA20, 0)) {
+        printf("OpenSSL does not provide SHA-256/HMAC/HKDF/BLAKE2s/ChaCha20\n");
+        return 1;
+    }
+
+    printf("Difftest: %ld vectors, %d threads, seed %llu\n", vectors, threads, (unsigned long long)seed);
+    long hex_pair_divergences = check_hex_pairs();
+    worker *workers = calloc(threads, sizeof(worker));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    long *divergences = calloc((size_t)threads * PATH_COUNT, sizeof(long));
+    uint64_t started = crp_now_ns();
+    for (int t = 0; t < threads; t++) {
+        workers[t].begin = vectors * t / threads;
+        workers[t].end = vectors * (t + 1) / threads;
+        workers[t].seed = seed;
+        workers[t].divergences = divergences + (size_t)t * PATH_COUNT;
+        pthread_create(&ids[t], NULL, worker_main, &workers[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    uint64_t elapsed = crp_now_ns() - started;
+
+    printf("\n%-10s %10s %12s %12s\n", "case", "vectors", "bob accepts", "alice acks");
+    for (int c = 0; c < CASE_COUNT; c++) {
+        long cases = 0, accepts = 0, acks = 0;
+        for (int t = 0; t < threads; t++) {
+            cases += workers[t].cases[c];
+            accepts += workers[t].bob_accepts[c];
+            acks += workers[t].alice_acks[c];
+        }
+        printf("%-10s %10ld %12ld %12ld\n", case_names[c], cases, accepts, acks);
+    }
+
+    long total = 0;
+    printf("\n%-10s %12s\n", "path", "divergences");
+    for (int p = 0; p < PATH_COUNT; p++) {
+        long count = p == 0 ? hex_pair_divergences : 0;
+        for (int t = 0; t < threads; t++) {
+            count += workers[t].divergences[p];
+        }
+        printf("%-10s %12ld\n", paths[p].name, count);
+        total += count;
+    }
+    long hw1_count = 0;
+    for (int t = 0; t < threads; t++) {
+        hw1_count += workers[t].hw1_divergences;
+    }
+    printf("%-10s %12ld\n", HW1_CHECK_NAME, hw1_count);
+    total += hw1_count;
+
+    printf("\nDifftest: %ld vectors in %.1f s (%.0f vectors/s, %d paths + %s each)\n",
+           vectors, elapsed / 1e9, vectors * 1e9 / elapsed, PATH_COUNT, HW1_CHECK_NAME);
+    if (total > 0) {
+        printf("Difftest: %ld divergences from the reference\n", total);
+    } else {
+        printf("Difftest: all paths match the reference\n");
+    }
+
+    free(divergences);
+    free(ids);
+    free(workers);
+    return total > 0 ? 1 : 0;
+}
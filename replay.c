@@ -0,0 +1,241 @@
+/**************************
+ *      Trace Replay        *
+ **************************
+ *
+ * Replays the Bob records of a trace captured with CRP_TRACE through the
+ * current protocol engine as fast as possible, checking that the signature
+ * verdict, decrypted message and response match the recording bit-for-bit,
+ * and reports warm in-process throughput. The recorded per-handshake time is
+ * shown for reference only: it comes from one cold handshake per alice/bob
+ * process, so the two are not directly comparable.
+ *
+ * Session-mode records are replayed on session subkeys derived once per
+ * distinct (key, session counter, session nonce), as a long-lived Bob would.
+ *
+ * Usage: ./replay <trace_file> [passes]
+ * Build: gcc -O2 replay.c -lssl -lcrypto -o replay
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define HASH_SIZE 32
+#define MESSAGE_SIZE 32
+
+#include "crp_engine.h"
+#include "crp_session.h"
+#include "crp_trace.h"
+
+typedef struct {
+    crp_trace_record rec;
+    crp_session *session;   // NULL for legacy-mode records
+} replay_record_t;
+
+typedef struct {
+    crp_session **items;               // Allocated one by one so records can point at them
+    const crp_trace_record **owners;   // First record of each session (key and start point)
+    size_t count;
+    size_t capacity;
+} session_cache;
+
+/*============================
+        Find or derive a session
+==============================*/
+static crp_session* session_for(session_cache *cache, const crp_trace_record *rec)
+{
+    for (size_t i = 0; i < cache->count; i++) {
+        const crp_trace_record *owner = cache->owners[i];
+        if (owner->session_counter == rec->session_counter &&
+            owner->session_nonce == rec->session_nonce &&
+            owner->key_len == rec->key_len &&
+            memcmp(owner->key, rec->key, rec->key_len) == 0) {
+            return cache->items[i];
+        }
+    }
+
+    if (cache->count == cache->capacity) {
+        cache->capacity = cache->capacity ? cache->capacity * 2 : 16;
+        cache->items = realloc(cache->items, cache->capacity * sizeof(crp_session*));
+        cache->owners = realloc(cache->owners, cache->capacity * sizeof(crp_trace_record*));
+    }
+    crp_session *session = malloc(sizeof(crp_session));
+    if (!crp_session_init(session, rec->key, rec->key_len,
+                          rec->session_counter, rec->session_nonce)) {
+        printf("Error deriving session keys\n");
+        exit(1);
+    }
+    cache->items[cache->count] = session;
+    cache->owners[cache->count++] = rec;
+    return session;
+}
+
+/*============================
+        Load trace into memory
+==============================*/
+// Keeps only Bob records; file I/O stays out of the timed loop
+static replay_record_t* load_trace(char* filename, size_t *count, size_t *skipped)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        printf("Error opening file: %s\n", filename);
+        exit(1);
+    }
+    if (!crp_trace_read_header(file)) {
+        printf("Error: %s is not a trace file (version %d)\n", filename, CRP_TRACE_VERSION);
+        fclose(file);
+        exit(1);
+    }
+
+    size_t capacity = 1024;
+    replay_record_t* records = malloc(capacity * sizeof(replay_record_t));
+    *count = 0;
+    *skipped = 0;
+
+    crp_trace_record rec;
+    int status;
+    while ((status = crp_trace_read(file, &rec)) == 1) {
+        if (rec.role != CRP_TRACE_BOB) {
+            free(rec.key);
+            (*skipped)++;
+            continue;
+        }
+        if (*count == capacity) {
+            capacity *= 2;
+            records = realloc(records, capacity * sizeof(replay_record_t));
+        }
+        records[*count].rec = rec;
+        records[*count].session = NULL;
+        (*count)++;
+    }
+    if (status < 0) {
+        printf("Warning: trace ends with a truncated record, ignoring it\n");
+    }
+
+    fclose(file);
+    return records;
+}
+
+/*============================
+        Run the Bob engine
+==============================*/
+static inline int bob_process(const replay_record_t *r, unsigned char message[MESSAGE_SIZE],
+                              unsigned char response[HASH_SIZE])
+{
+    const crp_trace_record *rec = &r->rec;
+    if (r->session != NULL) {
+        return crp_session_bob_process(r->session, rec->counter, rec->nonce,
+                                       rec->ciphertext, rec->signature, message, response);
+    }
+    return crp_bob_process(rec->key, rec->key_len, rec->counter, rec->nonce,
+                           rec->ciphertext, rec->signature, message, response);
+}
+
+/*============================
+        Replay one record
+==============================*/
+// Returns 1 if the engine reproduces the recorded outcome exactly
+static int replay_record(const replay_record_t *r)
+{
+    const crp_trace_record *rec = &r->rec;
+    unsigned char message[MESSAGE_SIZE] = {0};
+    unsigned char response[HASH_SIZE] = {0};
+    int verified = bob_process(r, message, response);
+
+    if (verified == CRP_SESSION_ERROR || verified != (rec->status == CRP_TRACE_OK)) {
+        return 0;
+    }
+    if (!verified) {
+        return 1;
+    }
+    return memcmp(message, rec->message, MESSAGE_SIZE) == 0 &&
+           memcmp(response, rec->response, HASH_SIZE) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3) {
+        printf("Usage: %s <trace_file> [passes]\n", argv[0]);
+        return 1;
+    }
+    long passes = argc == 3 ? atol(argv[2]) : 1;
+    if (passes < 1) {
+        printf("Passes must be at least 1\n");
+        return 1;
+    }
+
+    // Fetch every algorithm before the timed loop
+    if (!crp_crypto_init(CRP_ALG_SHA256 | CRP_ALG_HMAC | CRP_ALG_HKDF, 0)) {
+        printf("OpenSSL does not provide SHA-256/HMAC/HKDF\n");
+        return 1;
+    }
+
+    size_t count, skipped;
+    replay_record_t* records = load_trace(argv[1], &count, &skipped);
+    printf("Replay: %zu Bob records loaded (%zu Alice records skipped)\n", count, skipped);
+    if (count == 0) {
+        free(records);
+        return 0;
+    }
+
+    // Session setup happens once per session, before the timed loop
+    session_cache sessions = {0};
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].rec.mode == CRP_TRACE_SESSION) {
+            records[i].session = session_for(&sessions, &records[i].rec);
+        }
+    }
+    if (sessions.count > 0) {
+        printf("Replay: %zu session(s) derived\n", sessions.count);
+    }
+
+    // The first pass checks every record; later passes only measure
+    size_t mismatches = 0;
+    uint64_t recorded_ns = 0;
+    for (size_t i = 0; i < count; i++) {
+        recorded_ns += records[i].rec.elapsed_ns;
+        if (!replay_record(&records[i])) {
+            if (mismatches < 10) {
+                printf("Replay: mismatch at record %zu (counter %d, nonce %d)\n",
+                       i, records[i].rec.counter, records[i].rec.nonce);
+            }
+            mismatches++;
+        }
+    }
+
+    unsigned char message[MESSAGE_SIZE];
+    unsigned char response[HASH_SIZE];
+    unsigned long sink = 0;
+    uint64_t started = crp_now_ns();
+    for (long pass = 0; pass < passes; pass++) {
+        for (size_t i = 0; i < count; i++) {
+            sink += bob_process(&records[i], message, response) == 1;
+        }
+    }
+    uint64_t elapsed = crp_now_ns() - started;
+
+    double handshakes = (double)count * passes;
+    printf("Replay: %.0f handshakes in %.3f ms (%lu verified)\n", handshakes, elapsed / 1e6, sink);
+    printf("Replay: %.0f handshakes/s, %.1f ns/handshake (warm, in-process)\n",
+           handshakes * 1e9 / elapsed, elapsed / handshakes);
+    printf("Replay: recorded %.1f ns/handshake (one cold handshake per bob run, without session setup)\n",
+           (double)recorded_ns / count);
+    if (mismatches > 0) {
+        printf("Replay: %zu of %zu records did NOT match the recording\n", mismatches, count);
+    } else {
+        printf("Replay: all records match bit-for-bit\n");
+    }
+
+    for (size_t i = 0; i < sessions.count; i++) {
+        crp_session_free(sessions.items[i]);
+        free(sessions.items[i]);
+    }
+    free(sessions.items);
+    free(sessions.owners);
+    for (size_t i = 0; i < count; i++) {
+        free(records[i].rec.key);
+    }
+    free(records);
+    return mismatches > 0 ? 1 : 0;
+}
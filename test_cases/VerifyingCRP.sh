@@ -15,6 +15,7 @@ do
 	rm -f Signature.txt
 	rm -f Response.txt
 	rm -f Acknowledgment.txt
+	rm -f Session.txt
 
 
     if [ $i == 4 ]; then